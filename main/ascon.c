@@ -0,0 +1,171 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "ascon.h"
+
+#define ASCON_128_IV 0x80400c0600000000ULL
+#define ASCON_RATE 8
+#define ROR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+// 不足一块时的填充位，位于第len个字节的最高位
+#define ASCON_PAD(len) (0x80ULL << (56 - 8 * (len)))
+
+typedef struct
+{
+    uint64_t x0, x1, x2, x3, x4;
+} ascon_state_t;
+
+// 按大端读取len(<=8)个字节，其余字节为0
+static inline uint64_t load_bytes(const uint8_t *p, size_t len)
+{
+    uint64_t x = 0;
+    for (size_t i = 0; i < len; i++)
+        x |= (uint64_t)p[i] << (56 - 8 * i);
+    return x;
+}
+
+static inline void store_bytes(uint8_t *p, uint64_t x, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        p[i] = (uint8_t)(x >> (56 - 8 * i));
+}
+
+static inline void ascon_round(ascon_state_t *s, uint8_t c)
+{
+    uint64_t t0, t1, t2, t3, t4;
+    s->x2 ^= c;
+    // 替换层
+    s->x0 ^= s->x4;
+    s->x4 ^= s->x3;
+    s->x2 ^= s->x1;
+    t0 = ~s->x0 & s->x1;
+    t1 = ~s->x1 & s->x2;
+    t2 = ~s->x2 & s->x3;
+    t3 = ~s->x3 & s->x4;
+    t4 = ~s->x4 & s->x0;
+    s->x0 ^= t1;
+    s->x1 ^= t2;
+    s->x2 ^= t3;
+    s->x3 ^= t4;
+    s->x4 ^= t0;
+    s->x1 ^= s->x0;
+    s->x0 ^= s->x4;
+    s->x3 ^= s->x2;
+    s->x2 = ~s->x2;
+    // 线性扩散层
+    s->x0 ^= ROR64(s->x0, 19) ^ ROR64(s->x0, 28);
+    s->x1 ^= ROR64(s->x1, 61) ^ ROR64(s->x1, 39);
+    s->x2 ^= ROR64(s->x2, 1) ^ ROR64(s->x2, 6);
+    s->x3 ^= ROR64(s->x3, 10) ^ ROR64(s->x3, 17);
+    s->x4 ^= ROR64(s->x4, 7) ^ ROR64(s->x4, 41);
+}
+
+// 执行最后rounds轮置换
+static void ascon_permute(ascon_state_t *s, int rounds)
+{
+    for (int i = 12 - rounds; i < 12; i++)
+        ascon_round(s, (uint8_t)(((0x0f - i) << 4) | i));
+}
+
+static void ascon_init(ascon_state_t *s, const uint8_t *key, const uint8_t *nonce,
+                       const uint8_t *ad, size_t ad_len)
+{
+    uint64_t k0 = load_bytes(key, 8), k1 = load_bytes(key + 8, 8);
+    s->x0 = ASCON_128_IV;
+    s->x1 = k0;
+    s->x2 = k1;
+    s->x3 = load_bytes(nonce, 8);
+    s->x4 = load_bytes(nonce + 8, 8);
+    ascon_permute(s, 12);
+    s->x3 ^= k0;
+    s->x4 ^= k1;
+    // 关联数据
+    if (ad_len > 0)
+    {
+        for (; ad_len >= ASCON_RATE; ad += ASCON_RATE, ad_len -= ASCON_RATE)
+        {
+            s->x0 ^= load_bytes(ad, ASCON_RATE);
+            ascon_permute(s, 6);
+        }
+        s->x0 ^= load_bytes(ad, ad_len) ^ ASCON_PAD(ad_len);
+        ascon_permute(s, 6);
+    }
+    s->x4 ^= 1;
+}
+
+static void ascon_final(ascon_state_t *s, const uint8_t *key, uint8_t *tag)
+{
+    uint64_t k0 = load_bytes(key, 8), k1 = load_bytes(key + 8, 8);
+    s->x1 ^= k0;
+    s->x2 ^= k1;
+    ascon_permute(s, 12);
+    store_bytes(tag, s->x3 ^ k0, 8);
+    store_bytes(tag + 8, s->x4 ^ k1, 8);
+}
+
+/**
+ * @brief 加密并计算认证标签
+ *
+ * in与out可以是同一缓冲区。nonce在同一密钥下不能重复使用。
+ *
+ * @param tag 输出ASCON_TAG_LEN字节的标签，调用者可以只使用前面的部分
+ */
+void ascon128_encrypt(const uint8_t *key, const uint8_t *nonce,
+                      const uint8_t *ad, size_t ad_len,
+                      const uint8_t *in, uint8_t *out, size_t len,
+                      uint8_t *tag)
+{
+    ascon_state_t s;
+    ascon_init(&s, key, nonce, ad, ad_len);
+    for (; len >= ASCON_RATE; in += ASCON_RATE, out += ASCON_RATE, len -= ASCON_RATE)
+    {
+        s.x0 ^= load_bytes(in, ASCON_RATE);
+        store_bytes(out, s.x0, ASCON_RATE);
+        ascon_permute(&s, 6);
+    }
+    s.x0 ^= load_bytes(in, len) ^ ASCON_PAD(len);
+    store_bytes(out, s.x0, len);
+    ascon_final(&s, key, tag);
+}
+
+/**
+ * @brief 校验标签并解密
+ *
+ * in与out可以是同一缓冲区。标签校验失败时out被清零。
+ *
+ * @param tag_len 截短标签的长度，不大于ASCON_TAG_LEN
+ * @return false 标签不匹配
+ */
+bool ascon128_decrypt(const uint8_t *key, const uint8_t *nonce,
+                      const uint8_t *ad, size_t ad_len,
+                      const uint8_t *in, uint8_t *out, size_t len,
+                      const uint8_t *tag, size_t tag_len)
+{
+    ascon_state_t s;
+    uint8_t *start = out;
+    size_t total = len;
+    ascon_init(&s, key, nonce, ad, ad_len);
+    for (; len >= ASCON_RATE; in += ASCON_RATE, out += ASCON_RATE, len -= ASCON_RATE)
+    {
+        uint64_t c = load_bytes(in, ASCON_RATE);
+        store_bytes(out, s.x0 ^ c, ASCON_RATE);
+        s.x0 = c;
+        ascon_permute(&s, 6);
+    }
+    // 最后一块：用密文替换状态的前len个字节，再加填充位
+    uint64_t c = load_bytes(in, len);
+    uint64_t mask = len > 0 ? ~0ULL << (64 - 8 * len) : 0;
+    store_bytes(out, s.x0 ^ c, len);
+    s.x0 = (s.x0 & ~mask) ^ c ^ ASCON_PAD(len);
+    uint8_t expect[ASCON_TAG_LEN];
+    ascon_final(&s, key, expect);
+    // 常数时间比较
+    uint8_t diff = 0;
+    for (size_t i = 0; i < tag_len && i < ASCON_TAG_LEN; i++)
+        diff |= expect[i] ^ tag[i];
+    if (diff != 0 || tag_len == 0)
+    {
+        memset(start, 0, total);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef __ASCON_H__
+#define __ASCON_H__
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Ascon-128 (NIST轻量级密码标准的AEAD算法)，纯软件实现，不依赖硬件加密peer
+#define ASCON_KEY_LEN 16
+#define ASCON_NONCE_LEN 16
+#define ASCON_TAG_LEN 16
+
+void ascon128_encrypt(const uint8_t *key, const uint8_t *nonce,
+                      const uint8_t *ad, size_t ad_len,
+                      const uint8_t *in, uint8_t *out, size_t len,
+                      uint8_t *tag);
+bool ascon128_decrypt(const uint8_t *key, const uint8_t *nonce,
+                      const uint8_t *ad, size_t ad_len,
+                      const uint8_t *in, uint8_t *out, size_t len,
+                      const uint8_t *tag, size_t tag_len);
+#endif
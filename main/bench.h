@@ -0,0 +1,7 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+void bench_start(void);
+#endif
@@ -0,0 +1,153 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "chanmgr.h"
+
+// 2.4G信道间隔5MHz，20MHz带宽的AP会影响左右各4个信道
+#define CHANMGR_OVERLAP 4
+// 低于此信号强度的AP不计入占用度
+#define CHANMGR_RSSI_FLOOR -100
+
+void chanmgr_init(chanmgr_t *cm, uint8_t home, uint16_t loss_threshold)
+{
+    memset(cm, 0, sizeof(*cm));
+    cm->home = home;
+    cm->current = home;
+    cm->loss_threshold = loss_threshold;
+}
+
+/**
+ * @brief 记录一个扫描到的AP
+ *
+ * AP的信号越强、与信道的距离越近，对该信道的占用度贡献越大。
+ */
+void chanmgr_add_scan(chanmgr_t *cm, uint8_t channel, int8_t rssi)
+{
+    if (channel < CHANMGR_MIN_CHANNEL || channel > CHANMGR_MAX_CHANNEL || rssi <= CHANMGR_RSSI_FLOOR)
+    {
+        return;
+    }
+    uint32_t weight = rssi - CHANMGR_RSSI_FLOOR;
+    for (int c = CHANMGR_MIN_CHANNEL; c <= CHANMGR_MAX_CHANNEL; c++)
+    {
+        int d = c > channel ? c - channel : channel - c;
+        if (d <= CHANMGR_OVERLAP)
+        {
+            cm->occupancy[c] += weight * (CHANMGR_OVERLAP + 1 - d);
+        }
+    }
+    cm->scanned = true;
+}
+
+// 信道代价：历史丢包率为主(相邻信道的丢包按重叠程度计入)，扫描占用度为辅
+static uint32_t chanmgr_cost(const chanmgr_t *cm, uint8_t channel)
+{
+    uint32_t cost = cm->occupancy[channel];
+    for (int c = CHANMGR_MIN_CHANNEL; c <= CHANMGR_MAX_CHANNEL; c++)
+    {
+        int d = c > channel ? c - channel : channel - c;
+        if (d <= CHANMGR_OVERLAP)
+        {
+            cost += (uint32_t)cm->loss[c] * (CHANMGR_OVERLAP + 1 - d) * 4;
+        }
+    }
+    return cost;
+}
+
+/**
+ * @brief 获取代价最小的信道，代价相同时优先当前信道
+ */
+uint8_t chanmgr_best(const chanmgr_t *cm)
+{
+    uint8_t best = cm->current;
+    for (uint8_t c = CHANMGR_MIN_CHANNEL; c <= CHANMGR_MAX_CHANNEL; c++)
+    {
+        if (chanmgr_cost(cm, c) < chanmgr_cost(cm, best))
+        {
+            best = c;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 连接建立，下一次检查时按扫描结果选择信道
+ */
+void chanmgr_connected(chanmgr_t *cm)
+{
+    cm->fresh = true;
+}
+
+/**
+ * @brief 记录当前信道上一帧的发送结果
+ *
+ * 每CHANMGR_WINDOW帧更新一次当前信道的丢包率，其他信道的历史丢包率逐渐衰减，
+ * 使曾经拥塞的信道之后还有机会被重新选中。
+ */
+void chanmgr_record(chanmgr_t *cm, bool lost)
+{
+    cm->window_sent++;
+    if (lost)
+    {
+        cm->window_lost++;
+    }
+    if (cm->window_sent < CHANMGR_WINDOW)
+    {
+        return;
+    }
+    uint16_t rate = (uint32_t)cm->window_lost * 1000 / cm->window_sent;
+    for (uint8_t c = CHANMGR_MIN_CHANNEL; c <= CHANMGR_MAX_CHANNEL; c++)
+    {
+        if (c == cm->current)
+        {
+            cm->loss[c] = (cm->loss[c] * 3 + rate) / 4;
+        }
+        else
+        {
+            cm->loss[c] -= cm->loss[c] / 8;
+        }
+    }
+    cm->window_sent = 0;
+    cm->window_lost = 0;
+    if (cm->hold > 0)
+    {
+        cm->hold--;
+    }
+}
+
+/**
+ * @brief 判断是否需要切换信道
+ *
+ * @return 应切换到的信道，0表示保持当前信道
+ */
+uint8_t chanmgr_check(chanmgr_t *cm)
+{
+    uint8_t best;
+    // 连接后根据启动时的扫描结果切换到最空闲的信道
+    if (cm->fresh)
+    {
+        cm->fresh = false;
+        if (cm->scanned)
+        {
+            best = chanmgr_best(cm);
+            return best != cm->current ? best : 0;
+        }
+    }
+    if (cm->hold > 0 || cm->loss[cm->current] < cm->loss_threshold)
+    {
+        return 0;
+    }
+    best = chanmgr_best(cm);
+    return best != cm->current ? best : 0;
+}
+
+/**
+ * @brief 记录信道已切换，重新开始丢包统计
+ */
+void chanmgr_switched(chanmgr_t *cm, uint8_t channel)
+{
+    cm->current = channel;
+    cm->window_sent = 0;
+    cm->window_lost = 0;
+    cm->hold = CHANMGR_HOLD_WINDOWS;
+}
@@ -0,0 +1,41 @@
+#ifndef __CHANMGR_H__
+#define __CHANMGR_H__
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CHANMGR_MIN_CHANNEL 1
+#define CHANMGR_MAX_CHANNEL 13
+// 每统计这么多帧计算一次丢包率
+#define CHANMGR_WINDOW 32
+// 切换信道后至少经过这么多个统计窗口才允许再次切换，避免来回切换
+#define CHANMGR_HOLD_WINDOWS 4
+
+// 信道管理状态，不依赖ESP-IDF，可在主机上用模拟的丢包数据测试
+typedef struct
+{
+    uint8_t home;    // 发现对端使用的信道
+    uint8_t current; // 当前信道
+    uint16_t loss_threshold; // 切换阈值，千分比
+    bool scanned;            // 是否已有扫描结果
+    bool fresh;              // 连接刚建立，尚未按扫描结果选择信道
+    uint32_t occupancy[CHANMGR_MAX_CHANNEL + 1]; // 扫描得到的占用度
+    uint16_t loss[CHANMGR_MAX_CHANNEL + 1];      // 丢包率EWMA，千分比
+    uint16_t window_sent;
+    uint16_t window_lost;
+    uint16_t hold; // 剩余的保持窗口数
+} chanmgr_t;
+
+// 信道号是否在1~13之间，对端请求的信道必须先检查
+static inline bool chanmgr_valid(uint8_t channel)
+{
+    return channel >= CHANMGR_MIN_CHANNEL && channel <= CHANMGR_MAX_CHANNEL;
+}
+
+void chanmgr_init(chanmgr_t *cm, uint8_t home, uint16_t loss_threshold);
+void chanmgr_add_scan(chanmgr_t *cm, uint8_t channel, int8_t rssi);
+uint8_t chanmgr_best(const chanmgr_t *cm);
+void chanmgr_connected(chanmgr_t *cm);
+void chanmgr_record(chanmgr_t *cm, bool lost);
+uint8_t chanmgr_check(chanmgr_t *cm);
+void chanmgr_switched(chanmgr_t *cm, uint8_t channel);
+#endif
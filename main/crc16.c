@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <string.h>
+#include "crc16.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "crc16.c assumes a little-endian target"
+#endif
+
+#define CRC16_POLY 0x8408
+
+// crc16_table[k][b]：字节b之后再经过k个0字节的CRC，用于一次处理4字节
+static uint16_t crc16_table[4][256];
+
+void crc16_init(void)
+{
+    for (int b = 0; b < 256; b++)
+    {
+        uint16_t c = b;
+        for (int i = 0; i < 8; i++)
+            c = (c & 1) ? (c >> 1) ^ CRC16_POLY : c >> 1;
+        crc16_table[0][b] = c;
+    }
+    for (int k = 1; k < 4; k++)
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            uint16_t c = crc16_table[k - 1][b];
+            crc16_table[k][b] = (c >> 8) ^ crc16_table[0][c & 0xff];
+        }
+    }
+}
+
+static inline uint32_t crc16_byte(uint32_t c, uint8_t b)
+{
+    return (c >> 8) ^ crc16_table[0][(c ^ b) & 0xff];
+}
+
+// 按小端处理一个字，低16位先与当前CRC异或
+static inline uint32_t crc16_word(uint32_t c, uint32_t w)
+{
+    w ^= c;
+    return crc16_table[3][w & 0xff] ^ crc16_table[2][(w >> 8) & 0xff] ^
+           crc16_table[1][(w >> 16) & 0xff] ^ crc16_table[0][w >> 24];
+}
+
+/**
+ * @brief 计算CRC16，同时把数据复制到dst
+ *
+ * 源地址对齐后按4字节读取；目的地址也对齐时按4字节写入，否则逐字节写入。
+ * dst与src不能重叠。
+ */
+uint16_t crc16_copy(uint16_t crc, uint8_t *dst, const uint8_t *src, size_t len)
+{
+    uint32_t c = (uint16_t)~crc;
+    uint32_t w;
+    // 逐字节处理到源地址4字节对齐
+    for (; len > 0 && ((uintptr_t)src & 3) != 0; len--)
+    {
+        uint8_t b = *src++;
+        if (dst != NULL)
+            *dst++ = b;
+        c = crc16_byte(c, b);
+    }
+    if (dst == NULL)
+    {
+        for (; len >= 4; len -= 4, src += 4)
+        {
+            memcpy(&w, __builtin_assume_aligned(src, 4), 4);
+            c = crc16_word(c, w);
+        }
+    }
+    else if (((uintptr_t)dst & 3) == 0)
+    {
+        for (; len >= 4; len -= 4, src += 4, dst += 4)
+        {
+            memcpy(&w, __builtin_assume_aligned(src, 4), 4);
+            memcpy(__builtin_assume_aligned(dst, 4), &w, 4);
+            c = crc16_word(c, w);
+        }
+    }
+    else
+    {
+        for (; len >= 4; len -= 4, src += 4, dst += 4)
+        {
+            memcpy(&w, __builtin_assume_aligned(src, 4), 4);
+            dst[0] = w;
+            dst[1] = w >> 8;
+            dst[2] = w >> 16;
+            dst[3] = w >> 24;
+            c = crc16_word(c, w);
+        }
+    }
+    for (; len > 0; len--)
+    {
+        uint8_t b = *src++;
+        if (dst != NULL)
+            *dst++ = b;
+        c = crc16_byte(c, b);
+    }
+    return ~c;
+}
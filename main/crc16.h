@@ -0,0 +1,21 @@
+#ifndef __CRC16_H__
+#define __CRC16_H__
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 与ROM中crc16_le结果相同的CRC16(反射多项式0x8408，输入输出取反)，
+ * 按4字节查表，并可在计算的同时复制数据，收发路径上每个字节只经过一次。
+ * crc参数与返回值的含义和crc16_le一致，可以分段连续计算。
+ */
+
+// 生成查找表，使用其他函数前调用一次
+void crc16_init(void);
+// 复制len字节到dst并计算CRC，dst为NULL时只计算
+uint16_t crc16_copy(uint16_t crc, uint8_t *dst, const uint8_t *src, size_t len);
+
+static inline uint16_t crc16_update(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    return crc16_copy(crc, NULL, buf, len);
+}
+#endif
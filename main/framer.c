@@ -0,0 +1,272 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "framer.h"
+#include "serial_timing.h"
+
+#define SLIP_END 0xC0
+#define COBS_DELIMITER 0x00
+#define MAVLINK_V1_STX 0xFE
+#define MAVLINK_V2_STX 0xFD
+// MAVLink v1: STX LEN SEQ SYS COMP MSGID PAYLOAD CRC(2)
+#define MAVLINK_V1_OVERHEAD 8
+// MAVLink v2: STX LEN INCOMPAT COMPAT SEQ SYS COMP MSGID(3) PAYLOAD CRC(2) [SIGNATURE(13)]
+#define MAVLINK_V2_OVERHEAD 12
+#define MAVLINK_V2_SIGNATURE_LEN 13
+#define MAVLINK_IFLAG_SIGNED 0x01
+
+void framer_init(framer_t *f, framer_type_t type, uint8_t delimiter)
+{
+    f->type = type;
+    f->delimiter = delimiter;
+    framer_reset(f);
+}
+
+void framer_reset(framer_t *f)
+{
+    f->magic = 0;
+    f->pos = 0;
+    f->expect = 0;
+}
+
+// MAVLink按头部长度字段确定消息结尾，非起始字节会被跳过直到重新同步
+static bool framer_feed_mavlink(framer_t *f, uint8_t byte)
+{
+    if (f->pos == 0)
+    {
+        if (byte != MAVLINK_V1_STX && byte != MAVLINK_V2_STX)
+        {
+            return false;
+        }
+        f->magic = byte;
+        f->expect = 0;
+    }
+    else if (f->pos == 1 && f->magic == MAVLINK_V1_STX)
+    {
+        f->expect = byte + MAVLINK_V1_OVERHEAD;
+    }
+    else if (f->pos == 1)
+    {
+        // v2需要等到不兼容标志位才能确定长度，先暂存负载长度
+        f->expect = byte;
+    }
+    else if (f->pos == 2 && f->magic == MAVLINK_V2_STX)
+    {
+        f->expect += MAVLINK_V2_OVERHEAD;
+        if (byte & MAVLINK_IFLAG_SIGNED)
+        {
+            f->expect += MAVLINK_V2_SIGNATURE_LEN;
+        }
+    }
+    f->pos++;
+    if (f->pos > 2 && f->pos >= f->expect)
+    {
+        framer_reset(f);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief 向边界检测器输入一个字节
+ *
+ * @param f 边界检测器
+ * @param byte 串口收到的字节
+ *
+ * @return true 此字节是一条消息的最后一个字节
+ */
+bool framer_feed(framer_t *f, uint8_t byte)
+{
+    switch (f->type)
+    {
+    case FRAMER_TYPE_DELIMITER:
+        return byte == f->delimiter;
+    case FRAMER_TYPE_SLIP:
+        // 帧首的END只用于清除线路噪声，不构成消息
+        if (byte == SLIP_END)
+        {
+            bool end = f->pos > 0;
+            f->pos = 0;
+            return end;
+        }
+        f->pos++;
+        return false;
+    case FRAMER_TYPE_COBS:
+        return byte == COBS_DELIMITER;
+    case FRAMER_TYPE_MAVLINK:
+        return framer_feed_mavlink(f, byte);
+    case FRAMER_TYPE_NONE:
+    case FRAMER_TYPE_MODBUS_RTU:
+    default:
+        // 没有字节级边界，由调用者根据读取或帧间隔决定
+        return false;
+    }
+}
+
+/**
+ * @brief 在缓冲区中查找第一个消息边界
+ *
+ * @return 第一条完整消息的长度(包含结尾字节)，没有找到边界时返回0
+ */
+size_t framer_scan(framer_t *f, const uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (framer_feed(f, buf[i]))
+        {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 获取判定消息结束的线路空闲时间
+ *
+ * Modbus RTU以3.5个字符时间(每字符11位)的静默分隔帧，波特率高于19200时规范固定为1750us。
+ *
+ * @return 空闲时间(us)，0表示此检测器不使用帧间隔
+ */
+uint32_t framer_gap_us(const framer_t *f, uint32_t baud_rate)
+{
+    if (f->type != FRAMER_TYPE_MODBUS_RTU || baud_rate == 0)
+    {
+        return 0;
+    }
+    if (baud_rate > 19200)
+    {
+        return 1750;
+    }
+    return (uint32_t)(35ULL * 11 * 1000000 / 10 / baud_rate);
+}
+
+/**
+ * @brief 初始化串口输入拼帧
+ *
+ * idle_us、char_us、report_us、timing和flush_chunk初始为0，由调用者按串口配置设置。
+ */
+void framer_stream_init(framer_stream_t *s, framer_type_t type, uint8_t delimiter,
+                        uint8_t *frame, size_t frame_cap, framer_emit_t emit)
+{
+    framer_init(&s->framer, type, delimiter);
+    s->frame = frame;
+    s->frame_cap = frame_cap;
+    s->idle_us = 0;
+    s->char_us = 0;
+    s->report_us = 0;
+    s->timing = false;
+    s->flush_chunk = false;
+    s->emit = emit;
+    framer_stream_reset(s);
+}
+
+// 丢弃正在拼接的数据
+void framer_stream_reset(framer_stream_t *s)
+{
+    framer_reset(&s->framer);
+    s->frame_len = 0;
+    s->last_end_us = 0;
+}
+
+static void framer_stream_flush(framer_stream_t *s)
+{
+    if (s->frame_len > 0)
+    {
+        s->emit(s->frame, s->frame_len);
+        s->frame_len = 0;
+    }
+}
+
+/**
+ * @brief 编码上一个字节结束到end_us之间的空闲
+ *
+ * 不足一个字符的视为连续发送。已编码的部分计入last_end_us，空闲还在继续时下次只编码剩余部分。
+ */
+static void framer_stream_put_gap(framer_stream_t *s, int64_t end_us)
+{
+    if (s->last_end_us == 0)
+        return;
+    int64_t gap_us = end_us - s->last_end_us;
+    if (gap_us < s->char_us)
+        return;
+    if (gap_us > TIMING_GAP_MAX_US)
+        gap_us = TIMING_GAP_MAX_US;
+    if (s->frame_cap - s->frame_len < TIMING_TOKEN_MAX_LEN + TIMING_TOKEN_MAX_LEN)
+        framer_stream_flush(s);
+    s->frame_len += timing_put_gap(s->frame + s->frame_len, gap_us);
+    s->last_end_us += (gap_us + TIMING_GAP_UNIT_US / 2) / TIMING_GAP_UNIT_US * TIMING_GAP_UNIT_US;
+}
+
+/**
+ * @brief 输入一批连续到达的串口数据
+ *
+ * 同一批数据之间没有明显的线路空闲。在消息边界或无线帧装满时立即发送，
+ * 一批数据中有多条消息时逐条拆开。
+ *
+ * @param data 数据
+ * @param len 数据长度
+ * @param end_us 最后一个字节接收完成的时间
+ * @param idle_us 这批数据之后已经确认的线路空闲时间，0表示未知
+ */
+void framer_stream_push(framer_stream_t *s, const uint8_t *data, size_t len, int64_t end_us, uint32_t idle_us)
+{
+    if (len == 0)
+        return;
+    if (s->timing)
+    {
+        framer_stream_put_gap(s, end_us - (int64_t)len * s->char_us);
+        for (size_t i = 0; i < len; i++)
+        {
+            s->frame_len += timing_put_byte(s->frame + s->frame_len, data[i]);
+            if (framer_feed(&s->framer, data[i]) || s->frame_cap - s->frame_len < TIMING_TOKEN_MAX_LEN)
+                framer_stream_flush(s);
+        }
+    }
+    else
+    {
+        while (len > 0)
+        {
+            size_t room = s->frame_cap - s->frame_len;
+            size_t n = len < room ? len : room;
+            size_t end = framer_scan(&s->framer, data, n);
+            if (end > 0)
+                n = end;
+            memcpy(s->frame + s->frame_len, data, n);
+            s->frame_len += n;
+            data += n;
+            len -= n;
+            if (end > 0 || s->frame_len == s->frame_cap)
+                framer_stream_flush(s);
+        }
+    }
+    s->last_end_us = end_us;
+    // 这批数据之后的空闲已达到判定时间(Modbus帧间隔)，不必等到下一次轮询
+    if (s->flush_chunk || (idle_us > 0 && s->idle_us > 0 && idle_us >= s->idle_us))
+    {
+        if (s->timing)
+            framer_stream_put_gap(s, end_us + idle_us);
+        framer_stream_flush(s);
+        framer_reset(&s->framer);
+    }
+}
+
+/**
+ * @brief 线路空闲超时后发送未检测到结尾的消息
+ *
+ * 编码字节间隔时先把已确定的空闲编码在帧尾，空闲的剩余部分由下一批数据开头的间隔补足。
+ * 较短的停顿留在帧内，连续或断续的数据一直拼接到空闲超时或无线帧装满。
+ *
+ * @param now_us 当前时间
+ */
+void framer_stream_poll(framer_stream_t *s, int64_t now_us)
+{
+    // 最近report_us内到达的数据可能还在串口FIFO中，只有更早的空闲是确定的
+    int64_t quiet_until = now_us - s->report_us;
+    if (s->frame_len == 0 || s->idle_us == 0 || quiet_until - s->last_end_us < s->idle_us)
+        return;
+    if (s->timing)
+        framer_stream_put_gap(s, quiet_until);
+    framer_stream_flush(s);
+    framer_reset(&s->framer);
+}
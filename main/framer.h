@@ -0,0 +1,58 @@
+#ifndef __FRAMER_H__
+#define __FRAMER_H__
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 串口消息边界检测器类型
+typedef enum
+{
+    FRAMER_TYPE_NONE = 0,   // 不检测边界，按读取到的数据直接发送
+    FRAMER_TYPE_DELIMITER,  // 自定义分隔符结尾
+    FRAMER_TYPE_SLIP,       // SLIP(RFC1055)，0xC0结尾
+    FRAMER_TYPE_COBS,       // COBS，0x00结尾
+    FRAMER_TYPE_MAVLINK,    // MAVLink v1/v2，按头部长度字段
+    FRAMER_TYPE_MODBUS_RTU, // Modbus RTU，按3.5字符时间的帧间隔
+} framer_type_t;
+
+// 边界检测器状态，逐字节增量解析
+typedef struct
+{
+    framer_type_t type;
+    uint8_t delimiter; // FRAMER_TYPE_DELIMITER使用的分隔符
+    uint8_t magic;     // MAVLink起始字节，区分v1/v2
+    uint32_t pos;      // 当前消息已接收字节数
+    uint32_t expect;   // MAVLink消息总长度，0表示头部还未解析完
+} framer_t;
+
+void framer_init(framer_t *f, framer_type_t type, uint8_t delimiter);
+void framer_reset(framer_t *f);
+bool framer_feed(framer_t *f, uint8_t byte);
+size_t framer_scan(framer_t *f, const uint8_t *buf, size_t len);
+uint32_t framer_gap_us(const framer_t *f, uint32_t baud_rate);
+
+// 拼好一个无线帧后的回调
+typedef void (*framer_emit_t)(const uint8_t *data, size_t len);
+
+// 串口输入拼帧：按消息边界、线路空闲和无线帧容量把串口数据切成无线帧
+typedef struct
+{
+    framer_t framer;
+    uint8_t *frame;      // 正在拼接的无线帧
+    size_t frame_cap;    // 无线帧容量
+    size_t frame_len;    // 已拼接的长度
+    uint32_t idle_us;    // 线路空闲超过此时间时发送已拼接的数据，0表示不按空闲发送
+    uint32_t char_us;    // 单个字符的传输时间
+    uint32_t report_us;  // 字节到达后串口驱动上报它的最长延迟，更早的时间段内没有上报才能确认线路空闲
+    bool timing;         // 按serial_timing.h编码字节间隔
+    bool flush_chunk;    // 每批数据之后立即发送，用于不检测边界的情况
+    int64_t last_end_us; // 上一个字节接收完成的时间，0表示还没有收到数据
+    framer_emit_t emit;
+} framer_stream_t;
+
+void framer_stream_init(framer_stream_t *s, framer_type_t type, uint8_t delimiter,
+                        uint8_t *frame, size_t frame_cap, framer_emit_t emit);
+void framer_stream_reset(framer_stream_t *s);
+void framer_stream_push(framer_stream_t *s, const uint8_t *data, size_t len, int64_t end_us, uint32_t idle_us);
+void framer_stream_poll(framer_stream_t *s, int64_t now_us);
+#endif
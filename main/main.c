@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
@@ -18,72 +19,493 @@
 #include "rom/ets_sys.h"
 #include "rom/crc.h"
 #include "driver/uart.h"
+#include "esp_timer.h"
 #include "wlcon.h"
+#include "framer.h"
+#include "serial_timing.h"
+#include "bench.h"
+#include "spool.h"
+#include "mbudget.h"
 
 #define UART_BUF_SIZE CONFIG_UART_BUF_SIZE
 #define EX_UART_NUM UART_NUM_0
+#define UART_BAUD_RATE 115200
 #define WIRELESS_RECV_QUEUE_SIZE CONFIG_WLCON_IO_QUEUE_SIZE
 #define WIRELESS_SEND_QUEUE_SIZE CONFIG_WLCON_IO_QUEUE_SIZE
+// 补发断线缓存时发送队列中最多保留的缓存帧数，保证实时数据不会排在大量缓存数据之后
+#define SPOOL_DRAIN_DEPTH 2
 static char *TAG = "MAIN";
 
 static xQueueHandle wlcon_send_queue = NULL,
                     wlcon_recv_queue = NULL;
+// 队列长度只是元素个数上限，缓存的数据量由内存预算限制
+MBUDGET_QUEUE_DEFINE(wlcon_send_queue, WIRELESS_SEND_QUEUE_SIZE, sizeof(buf_len_t));
+MBUDGET_QUEUE_DEFINE(wlcon_recv_queue, WIRELESS_RECV_QUEUE_SIZE, sizeof(buf_len_t));
 
-void uart_rx_task(void *param)
+#if CONFIG_WLCON_DIAG_STREAM
+// 诊断信息从只有TX的UART1(GPIO2)输出，不干扰透传串口
+#define DIAG_UART_NUM UART_NUM_1
+#define DIAG_QUEUE_SIZE 4
+// 一行诊断信息的缓冲区(含结尾的'\0')，内容不超过单帧负载，过长时截断
+#define DIAG_LINE_MAX (WIRELESS_PACKET_MAX_PAYLOAD_SIZE < 224 ? WIRELESS_PACKET_MAX_PAYLOAD_SIZE + 1 : 224)
+static xQueueHandle diag_send_queue = NULL,
+                    diag_recv_queue = NULL;
+MBUDGET_QUEUE_DEFINE(diag_send_queue, DIAG_QUEUE_SIZE, sizeof(buf_len_t));
+MBUDGET_QUEUE_DEFINE(diag_recv_queue, DIAG_QUEUE_SIZE, sizeof(buf_len_t));
+#endif
+
+#if CONFIG_WLCON_FRAMER_DELIMITER
+#define SERIAL_FRAMER_TYPE FRAMER_TYPE_DELIMITER
+#define SERIAL_FRAMER_DELIMITER CONFIG_WLCON_FRAMER_DELIMITER_CHAR
+#elif CONFIG_WLCON_FRAMER_SLIP
+#define SERIAL_FRAMER_TYPE FRAMER_TYPE_SLIP
+#elif CONFIG_WLCON_FRAMER_COBS
+#define SERIAL_FRAMER_TYPE FRAMER_TYPE_COBS
+#elif CONFIG_WLCON_FRAMER_MAVLINK
+#define SERIAL_FRAMER_TYPE FRAMER_TYPE_MAVLINK
+#elif CONFIG_WLCON_FRAMER_MODBUS_RTU
+#define SERIAL_FRAMER_TYPE FRAMER_TYPE_MODBUS_RTU
+#else
+#define SERIAL_FRAMER_TYPE FRAMER_TYPE_NONE
+#endif
+#ifndef SERIAL_FRAMER_DELIMITER
+#define SERIAL_FRAMER_DELIMITER 0
+#endif
+#ifndef CONFIG_WLCON_FRAMER_IDLE_MS
+#define CONFIG_WLCON_FRAMER_IDLE_MS 0
+#endif
+
+// 把一条串口消息放入无线发送队列，返回false时数据未被接收
+static bool serial_frame_queue(const uint8_t *data, size_t len)
+{
+    uint8_t *buf = malloc(len);
+    if (buf == NULL)
+    {
+        ESP_LOGE(__FUNCTION__, "Malloc serial frame fail");
+        return false;
+    }
+    memcpy(buf, data, len);
+    ESP_LOGD(__FUNCTION__, "send [serial->esp_now]:%d bytes", (int)len);
+    buf_len_t send_data = {
+        .len = len,
+        .buf = buf,
+        .flag = 0x01,
+    };
+    if (!wlcon_send(&send_data, pdMS_TO_TICKS(10)))
+    {
+        // 被拒绝的次数计入发送阶段的统计，由调用者决定重试或丢弃
+        ESP_LOGD(__FUNCTION__, "Failed to send data into wlcon send queue.");
+        free(buf);
+        return false;
+    }
+    return true;
+}
+
+// 发送一条串口消息，断线期间放入断线缓存
+static bool serial_frame_send(const uint8_t *data, size_t len)
+{
+    if (len == 0)
+        return true;
+#if CONFIG_WLCON_SPOOL
+    // 断线期间缓存，连接恢复后补发
+    if (!wlcon_is_connected())
+    {
+        return spool_put(data, len);
+    }
+#endif
+    return serial_frame_queue(data, len);
+}
+
+#if !CONFIG_WLCON_TIMING_PRESERVE
+// 把无线收到的一条数据写入串口，最多等待wait
+static bool wireless_forward(TickType_t wait)
 {
-    uint8_t *serial_data = NULL;
-    size_t rx_len = 0;
     buf_len_t wireless_data;
+    if (!wlcon_recv(&wireless_data, wait))
+        return false;
+    if (wireless_data.len > 0 && wireless_data.buf != NULL)
+    {
+        ESP_LOGD(__FUNCTION__, "recv [esp_now->serial]:%d bytes", wireless_data.len);
+        uart_write_bytes(EX_UART_NUM, (const char *)wireless_data.buf, wireless_data.len);
+        free(wireless_data.buf);
+    }
+    return true;
+}
+#endif
+
+/**
+ * @brief framer_stream的输出回调
+ *
+ * 背压策略下连接期间等待发送额度和队列空位，后续串口数据留在驱动的缓冲区中；
+ * 其他策略或断线时发送队列(或断线缓存)不接收的消息丢弃。
+ */
+static void serial_frame_emit(const uint8_t *data, size_t len)
+{
+    while (!serial_frame_send(data, len))
+    {
+        if (mbudget_policy(MBUDGET_TX) != MBUDGET_BACKPRESSURE || !wlcon_is_connected())
+        {
+            ESP_LOGW(__FUNCTION__, "Serial frame dropped, %d bytes", (int)len);
+            return;
+        }
+#if CONFIG_WLCON_TIMING_PRESERVE
+        vTaskDelay(1);
+#else
+        // 等待期间继续输出无线数据，两端同时等待时不会互相占满对方的接收额度
+        wireless_forward(1);
+#endif
+    }
+}
+
+// 单个字符(1起始位+8数据位+1停止位)的传输时间(us)
+#define UART_CHAR_US (10 * 1000000 / UART_BAUD_RATE)
+#define UART_EVENT_QUEUE_SIZE 32
+// 接收FIFO(128字节)中的数据达到此长度时驱动上报一批数据
+#if CONFIG_WLCON_TIMING_PRESERVE
+// 保留字节间隔时减小阈值，一段数据的开头尽早上报，开头的时间由上报时间倒推
+#define UART_RXFIFO_FULL_THRESH 16
+#else
+#define UART_RXFIFO_FULL_THRESH 100
+#endif
+#define UART_TXFIFO_EMPTY_THRESH 10
+// 线路空闲这么多字符时间后驱动上报FIFO中剩余的数据，寄存器最大127
+#define UART_RX_TOUT_DEFAULT 2
+#define UART_RX_TOUT_MAX 127
+
+#if CONFIG_WLCON_TIMING_PRESERVE
+// 不检测边界时，线路空闲这么久后发送已拼接的数据
+#define TIMING_FLUSH_IDLE_US 1000
+// 间隔按计时单位四舍五入，误差需小于一个字符
+#if TIMING_GAP_UNIT_US > 2 * UART_CHAR_US
+#error "TIMING_GAP_UNIT_US is too coarse for UART_BAUD_RATE"
+#endif
+#endif
+
+static xQueueHandle uart_event_queue = NULL;
+
+// 一次读取通常最多产生两帧，更多时由serial_frame_emit等待
+#define SERIAL_TX_SLOTS (WIRELESS_SEND_QUEUE_SIZE < 2 ? WIRELESS_SEND_QUEUE_SIZE : 2)
+
+/**
+ * @brief 发送队列空位或发送额度不足以容纳两帧时暂不读取串口，数据留在串口驱动的缓冲区中
+ *
+ * 额度只在背压策略下检查，发送阶段为空时总是读取：额度小于两帧时否则永远等不到额度释放。
+ * 断线期间串口数据不进入发送队列，总是读取。
+ */
+static bool serial_tx_ready(void)
+{
+    mbudget_stats_t st;
+    if (!wlcon_is_connected())
+        return true;
+    if (uxQueueSpacesAvailable(wlcon_send_queue) < SERIAL_TX_SLOTS)
+        return false;
+    if (mbudget_policy(MBUDGET_TX) != MBUDGET_BACKPRESSURE)
+        return true;
+    mbudget_get_stats(MBUDGET_TX, &st);
+    return st.used == 0 || mbudget_available(MBUDGET_TX) >= 2 * MBUDGET_CHARGE(WIRELESS_PACKET_MAX_PAYLOAD_SIZE);
+}
+
+/**
+ * @brief 按接收超时中断划分串口数据
+ *
+ * 驱动在FIFO达到UART_RXFIFO_FULL_THRESH或线路空闲rx_timeout_thresh个字符时上报一批数据，
+ * 不足UART_RXFIFO_FULL_THRESH的一批一定以线路空闲结尾。Modbus RTU把接收超时设为帧间隔，
+ * 同一次读取中不会出现两帧，帧结束后立即发送，不依赖轮询的时机。
+ *
+ * @return 接收超时(字符时间)
+ */
+static uint32_t uart_rx_intr_config(uint32_t gap_us)
+{
+#if CONFIG_WLCON_TIMING_PRESERVE
+    // 保留字节间隔时一个字符以上的停顿都要单独上报，停顿的长度由上报时间测量
+    uint32_t tout = 1;
+    (void)gap_us;
+#else
+    uint32_t tout = UART_RX_TOUT_DEFAULT;
+    // 不超过帧间隔，保证规定长度的静默一定触发接收超时
+    if (gap_us > 0)
+        tout = gap_us / UART_CHAR_US;
+#endif
+    if (tout == 0)
+        tout = 1;
+    if (tout > UART_RX_TOUT_MAX)
+        tout = UART_RX_TOUT_MAX;
+    uart_intr_config_t uart_intr = {
+        .intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_TOUT_INT_ENA_M |
+                            UART_FRM_ERR_INT_ENA_M | UART_RXFIFO_OVF_INT_ENA_M,
+        .rxfifo_full_thresh = UART_RXFIFO_FULL_THRESH,
+        .rx_timeout_thresh = tout,
+        .txfifo_empty_intr_thresh = UART_TXFIFO_EMPTY_THRESH,
+    };
+    if (uart_intr_config(EX_UART_NUM, &uart_intr) != ESP_OK)
+        ESP_LOGE(TAG, "Config uart interrupt fail");
+    return tout;
+}
+
+// 任务栈上有两个无线帧大小的缓冲区
+MBUDGET_TASK_DEFINE(uart_rx_task, 2048 + 2 * WIRELESS_PACKET_MAX_PAYLOAD_SIZE);
+
+void uart_rx_task(void *param)
+{
+    uint8_t serial_data[WIRELESS_PACKET_MAX_PAYLOAD_SIZE];
+    // 正在拼接的消息
+    uint8_t frame[WIRELESS_PACKET_MAX_PAYLOAD_SIZE];
+    framer_stream_t stream;
+    uart_event_t event;
+    // 接收缓冲区满过之后，缓冲区中会有没有对应事件的数据，按实际长度读取直到线路空闲
+    bool resync = false;
+    framer_stream_init(&stream, SERIAL_FRAMER_TYPE, SERIAL_FRAMER_DELIMITER, frame, sizeof(frame), serial_frame_emit);
+    stream.char_us = UART_CHAR_US;
+#if CONFIG_WLCON_TIMING_PRESERVE
+    stream.timing = true;
+#endif
+    // 消息结束判定的空闲时间，Modbus RTU使用按字符时间取整后的帧间隔
+    uint32_t gap_us = framer_gap_us(&stream.framer, UART_BAUD_RATE);
+    const uint32_t tout_us = uart_rx_intr_config(gap_us) * UART_CHAR_US;
+    stream.report_us = UART_RXFIFO_FULL_THRESH * UART_CHAR_US + tout_us;
+    stream.idle_us = gap_us > 0 ? gap_us / UART_CHAR_US * UART_CHAR_US : CONFIG_WLCON_FRAMER_IDLE_MS * 1000;
+#if CONFIG_WLCON_TIMING_PRESERVE
+    // 不检测边界时一直拼接到线路空闲TIMING_FLUSH_IDLE_US或无线帧装满，短停顿编码在帧内
+    if (stream.idle_us == 0)
+        stream.idle_us = TIMING_FLUSH_IDLE_US;
+#else
+    stream.flush_chunk = SERIAL_FRAMER_TYPE == FRAMER_TYPE_NONE;
+#endif
 
     while (1)
     {
-        vTaskDelay(5);
-        if (xQueueReceive(wlcon_recv_queue, &wireless_data, pdMS_TO_TICKS(10)) == pdTRUE)
+#if CONFIG_WLCON_TIMING_PRESERVE
+        // 无线数据由uart_playout_task按时序输出，这里阻塞等待串口事件，醒来的时间就是数据上报的时间
+        TickType_t wait = stream.frame_len > 0 ? 1 : pdMS_TO_TICKS(10);
+#else
+        // 有未完成的消息、待处理的串口数据或待补发的缓存时加快轮询
+        bool pending = uxQueueMessagesWaiting(uart_event_queue) > 0;
+        bool busy = pending || stream.frame_len > 0;
+#if CONFIG_WLCON_SPOOL
+        busy = busy || (wlcon_is_connected() && !spool_is_empty());
+#endif
+        if (!busy)
+            vTaskDelay(5);
+        wireless_forward(pending ? 0 : busy ? 1 : pdMS_TO_TICKS(10));
+        TickType_t wait = 0;
+#endif
+#if CONFIG_WLCON_SPOOL
+        // 补发断线期间缓存的数据，与实时数据交替进入发送队列
+        while (wlcon_is_connected() && uxQueueMessagesWaiting(wlcon_send_queue) < SPOOL_DRAIN_DEPTH)
         {
-            // 有数据接收
-            if (wireless_data.len > 0 && wireless_data.buf != NULL)
+            size_t spool_len = spool_get(serial_data, sizeof(serial_data));
+            if (spool_len == 0)
+                break;
+            // 发送队列不接收时放回缓存的最前面，停止补发，稍后按原顺序重试
+            if (!serial_frame_queue(serial_data, spool_len))
             {
-                ESP_LOGD(__FUNCTION__, "recv [esp_now->serial]:%s", (char *)wireless_data.buf);
-                uart_write_bytes(EX_UART_NUM, (const char *)wireless_data.buf, wireless_data.len);
-                free(wireless_data.buf);
+                if (!spool_put_front(serial_data, spool_len) && !spool_put(serial_data, spool_len))
+                    ESP_LOGW(__FUNCTION__, "Spool frame fail, %d bytes lost", (int)spool_len);
+                break;
             }
         }
-        // 判断用户是否输入
-        esp_err_t err = uart_get_buffered_data_len(EX_UART_NUM, &rx_len);
-        if (err != ESP_OK)
+#endif
+        if (!serial_tx_ready())
         {
-            ESP_LOGE(__FUNCTION__, "Error: %d", err);
+            // 有待处理的串口事件时上面不会阻塞，这里让出CPU等待额度释放
+            vTaskDelay(1);
             continue;
         }
-        if (rx_len <= 0)
+        if (!xQueueReceive(uart_event_queue, &event, wait))
+        {
+            // 线路空闲超时，发送未检测到结尾的消息
+            framer_stream_poll(&stream, esp_timer_get_time());
             continue;
+        }
+        int64_t now = esp_timer_get_time();
+        if (event.type == UART_BUFFER_FULL || event.type == UART_FIFO_OVF)
+        {
+            ESP_LOGW(__FUNCTION__, "uart rx overflow: %d", event.type);
+            resync = resync || event.type == UART_BUFFER_FULL;
+            continue;
+        }
+        if (event.type != UART_DATA)
+            continue;
+#if !CONFIG_WLCON_SPOOL
         // 未连接但是有用户输入，则提示输入无效
         if (!wlcon_is_connected())
         {
             // 直接清除输入缓冲区
             uart_flush_input(EX_UART_NUM);
+            xQueueReset(uart_event_queue);
             uart_write_bytes(EX_UART_NUM, "未连接输入无效\r\n", strlen("未连接输入无效\r\n"));
+            framer_stream_reset(&stream);
+            resync = false;
+            continue;
+        }
+#endif
+        size_t rx_len = 0;
+        if (uart_get_buffered_data_len(EX_UART_NUM, &rx_len) != ESP_OK)
             continue;
+        if (!resync && event.size < rx_len)
+            rx_len = event.size;
+        // 以接收超时结尾的一批数据之后线路已空闲tout_us
+        uint32_t idle_us = event.size < UART_RXFIFO_FULL_THRESH ? tout_us : 0;
+        // 读取输入并转发，超过缓冲区时分多次读取
+        while (rx_len > 0)
+        {
+            size_t len = rx_len > sizeof(serial_data) ? sizeof(serial_data) : rx_len;
+            int serial_rx_len = uart_read_bytes(EX_UART_NUM, serial_data, len, 0);
+            if (serial_rx_len <= 0)
+                break;
+            rx_len -= serial_rx_len;
+            uint32_t after_us = rx_len == 0 ? idle_us : 0;
+            framer_stream_push(&stream, serial_data, serial_rx_len,
+                               now - idle_us - (int64_t)rx_len * UART_CHAR_US, after_us);
+        }
+        if (resync && idle_us > 0 && uxQueueMessagesWaiting(uart_event_queue) == 0 &&
+            uart_get_buffered_data_len(EX_UART_NUM, &rx_len) == ESP_OK && rx_len == 0)
+            resync = false;
+    }
+}
+
+#if CONFIG_WLCON_TIMING_PRESERVE
+// 等待到指定时间，整毫秒部分让出CPU，剩余部分忙等以达到字符级精度
+static void wait_until(int64_t when)
+{
+    int64_t remain = when - esp_timer_get_time();
+    if (remain > 1000)
+    {
+        vTaskDelay(pdMS_TO_TICKS(remain / 1000));
+        remain = when - esp_timer_get_time();
+    }
+    if (remain > 0)
+        ets_delay_us(remain);
+}
+
+/**
+ * @brief 按发送端记录的字节间隔回放无线数据
+ *
+ * 接收队列作为抖动缓冲区：一段连续数据的第一帧延迟CONFIG_WLCON_TIMING_PLAYOUT_DELAY_MS后开始输出，
+ * 之后的帧按发送端的时间线紧接着输出，只要无线抖动小于播放延迟，帧间隔就不会被压缩或拉长。
+ */
+MBUDGET_TASK_DEFINE(uart_playout_task, 2048 + WIRELESS_PACKET_MAX_PAYLOAD_SIZE);
+
+void uart_playout_task(void *param)
+{
+    const int64_t playout_delay_us = CONFIG_WLCON_TIMING_PLAYOUT_DELAY_MS * 1000LL;
+    uint8_t run[WIRELESS_PACKET_MAX_PAYLOAD_SIZE];
+    size_t run_len = 0;
+    uint32_t gap_us = 0;
+    // 下一个字节的计划输出时间
+    int64_t play_at = 0;
+    buf_len_t wireless_data;
+
+    while (1)
+    {
+        if (!wlcon_recv(&wireless_data, portMAX_DELAY))
+            continue;
+        if (wireless_data.len == 0 || wireless_data.buf == NULL)
+            continue;
+        int64_t now = esp_timer_get_time();
+        size_t pos = 0;
+        // 缓冲区欠载，重新建立播放延迟；此时帧首的间隔已包含在播放延迟中
+        if (play_at < now)
+        {
+            play_at = now + playout_delay_us;
+            if (wireless_data.len >= 2 && wireless_data.buf[0] == TIMING_ESC && wireless_data.buf[1] != 0x00)
+                pos = 2;
         }
-        // 读取输入并转发
-        serial_data = malloc(rx_len);
-        int serial_rx_len = uart_read_bytes(EX_UART_NUM, serial_data, rx_len, 0);
-        if (serial_rx_len > 0)
+        while (pos < wireless_data.len)
         {
-            ESP_LOGD(__FUNCTION__, "send [serial->esp_now]:%s", (char *)serial_data);
-            // 发送数据包
-            buf_len_t send_data = {
-                .len = serial_rx_len,
-                .buf = serial_data,
-                .flag = 0x01,
-            };
-            if (xQueueSend(wlcon_send_queue, &send_data, pdMS_TO_TICKS(10)) != pdTRUE)
+            pos += timing_decode(wireless_data.buf + pos, wireless_data.len - pos, run, &run_len, &gap_us);
+            if (run_len > 0)
+            {
+                wait_until(play_at);
+                uart_write_bytes(EX_UART_NUM, (const char *)run, run_len);
+                play_at += (int64_t)run_len * UART_CHAR_US;
+            }
+            if (gap_us > 0)
             {
-                ESP_LOGE(__FUNCTION__, "Failed to send data into wlcon_send_queue.");
+                // 间隔从最后一个字节实际发送完成开始计算
+                uart_wait_tx_done(EX_UART_NUM, portMAX_DELAY);
+                now = esp_timer_get_time();
+                if (play_at < now)
+                    play_at = now;
+                play_at += gap_us;
             }
         }
+        free(wireless_data.buf);
     }
 }
+#endif
+
+#if CONFIG_WLCON_DIAG_STREAM
+// 生成一行本机链路统计
+static int diag_format(char *line, size_t size)
+{
+    wlcon_stats_t stats;
+    wlcon_get_stats(&stats);
+    int len = snprintf(line, size, "peer: tx %u frames %u bytes, rx %u frames %u bytes, retrans %u, drop %u, crc %u, heap %u",
+                       stats.tx_frames, stats.tx_bytes, stats.rx_frames, stats.rx_bytes,
+                       stats.tx_retrans, stats.tx_drop, stats.crc_errors, esp_get_free_heap_size());
+    // 各阶段内存的最高使用量/额度
+    mbudget_stats_t mem[MBUDGET_STAGE_MAX];
+    for (int i = 0; i < MBUDGET_STAGE_MAX; i++)
+        mbudget_get_stats(i, &mem[i]);
+    if (len > 0 && (size_t)len < size)
+        len += snprintf(line + len, size - len, ", mem tx %u/%u rx %u/%u cb %u/%u",
+                        mem[MBUDGET_TX].high_water, mem[MBUDGET_TX].limit, mem[MBUDGET_RX].high_water,
+                        mem[MBUDGET_RX].limit, mem[MBUDGET_CB].high_water, mem[MBUDGET_CB].limit);
+#if CONFIG_WLCON_SPOOL
+    spool_stats_t spool;
+    spool_get_stats(&spool);
+    if (len > 0 && (size_t)len < size)
+        len += snprintf(line + len, size - len, ", spool %u/%u dropped %u", spool.drained, spool.stored, spool.dropped);
+#endif
+    if (len > 0 && (size_t)len < size)
+        len += snprintf(line + len, size - len, "\r\n");
+    if (len < 0)
+        return 0;
+    return (size_t)len < size ? len : (int)size - 1;
+}
+
+/**
+ * @brief 诊断通道：定期把本机链路统计发给对端，收到的对端诊断信息从UART1输出
+ *
+ * 诊断通道的优先级高于透传通道，透传数据再多也只需等待正在发送的一帧。
+ */
+MBUDGET_TASK_DEFINE(diag_task, 2048);
+
+void diag_task(void *param)
+{
+    const TickType_t interval = pdMS_TO_TICKS(CONFIG_WLCON_DIAG_INTERVAL_S * 1000);
+    TickType_t last_report = xTaskGetTickCount();
+    buf_len_t diag_data;
+
+    while (1)
+    {
+        TickType_t elapsed = xTaskGetTickCount() - last_report;
+        if (wlcon_stream_recv(WLCON_STREAM_DIAG, &diag_data, elapsed < interval ? interval - elapsed : 0))
+        {
+            uart_write_bytes(DIAG_UART_NUM, (const char *)diag_data.buf, diag_data.len);
+            free(diag_data.buf);
+            continue;
+        }
+        last_report = xTaskGetTickCount();
+        if (!wlcon_is_connected())
+            continue;
+        char *line = malloc(DIAG_LINE_MAX);
+        if (line == NULL)
+        {
+            ESP_LOGE(__FUNCTION__, "Malloc diag line fail");
+            continue;
+        }
+        buf_len_t send_data = {
+            .len = diag_format(line, DIAG_LINE_MAX),
+            .buf = (uint8_t *)line,
+            .flag = 0x01,
+        };
+        if (!wlcon_stream_send(WLCON_STREAM_DIAG, &send_data, 0))
+            free(line);
+    }
+}
+#endif
 
 void app_main()
 {
@@ -92,25 +514,57 @@ void app_main()
     wifi_init();
     ESP_ERROR_CHECK(wlcon_init());
     // 注册无线输入输出队列
-    wlcon_send_queue = xQueueCreate(WIRELESS_SEND_QUEUE_SIZE, sizeof(buf_len_t));
-    wlcon_recv_queue = xQueueCreate(WIRELESS_RECV_QUEUE_SIZE, sizeof(buf_len_t));
+    wlcon_send_queue = MBUDGET_QUEUE_CREATE(wlcon_send_queue, WIRELESS_SEND_QUEUE_SIZE, sizeof(buf_len_t));
+    wlcon_recv_queue = MBUDGET_QUEUE_CREATE(wlcon_recv_queue, WIRELESS_RECV_QUEUE_SIZE, sizeof(buf_len_t));
     if (wlcon_send_queue == NULL || wlcon_recv_queue == NULL)
     {
         ESP_LOGE(TAG, "Create queue fail");
         esp_restart();
     }
     wlcon_io_register(wlcon_send_queue, wlcon_recv_queue);
+#if CONFIG_WLCON_BENCHMARK
+    // 测试模式下由测试任务产生数据，不启动串口透传
+    bench_start();
+    vTaskDelete(NULL);
+#endif
+
+#if CONFIG_WLCON_SPOOL
+    ESP_ERROR_CHECK(spool_init());
+#endif
 
     // 初始化串口
     uart_config_t uart_config = {
-        .baud_rate = 115200,
+        .baud_rate = UART_BAUD_RATE,
         .data_bits = UART_DATA_8_BITS,
         .parity = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
         .flow_ctrl = UART_HW_FLOWCTRL_DISABLE};
     uart_param_config(EX_UART_NUM, &uart_config);
-    uart_driver_install(EX_UART_NUM, CONFIG_UART_BUF_SIZE * 2, CONFIG_UART_BUF_SIZE * 2, 0, NULL, 0);
-    xTaskCreate(uart_rx_task, "uart_rx_task", 2048, NULL, 4, NULL);
+    uart_driver_install(EX_UART_NUM, CONFIG_UART_BUF_SIZE * 2, CONFIG_UART_BUF_SIZE * 2, UART_EVENT_QUEUE_SIZE, &uart_event_queue, 0);
+#if CONFIG_WLCON_TIMING_PRESERVE
+    // 间隔由任务被串口事件唤醒的时间测量，优先于连接管理任务以减小唤醒延迟
+    MBUDGET_TASK_CREATE(uart_rx_task, NULL, CONFIG_WLCON_MANAGER_PRORITY + 1);
+#else
+    MBUDGET_TASK_CREATE(uart_rx_task, NULL, 4);
+#endif
+#if CONFIG_WLCON_TIMING_PRESERVE
+    MBUDGET_TASK_CREATE(uart_playout_task, NULL, 5);
+#endif
+
+#if CONFIG_WLCON_DIAG_STREAM
+    // 诊断通道优先于透传通道
+    diag_send_queue = MBUDGET_QUEUE_CREATE(diag_send_queue, DIAG_QUEUE_SIZE, sizeof(buf_len_t));
+    diag_recv_queue = MBUDGET_QUEUE_CREATE(diag_recv_queue, DIAG_QUEUE_SIZE, sizeof(buf_len_t));
+    if (diag_send_queue == NULL || diag_recv_queue == NULL)
+    {
+        ESP_LOGE(TAG, "Create queue fail");
+        esp_restart();
+    }
+    ESP_ERROR_CHECK(wlcon_stream_register(WLCON_STREAM_DIAG, diag_send_queue, diag_recv_queue, 1, 1));
+    uart_param_config(DIAG_UART_NUM, &uart_config);
+    uart_driver_install(DIAG_UART_NUM, CONFIG_UART_BUF_SIZE, 0, 0, NULL, 0);
+    MBUDGET_TASK_CREATE(diag_task, NULL, 3);
+#endif
 
     // 删除自身任务
     vTaskDelete(NULL);
@@ -0,0 +1,216 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "mbudget.h"
+
+#if CONFIG_WLCON_MEM_BUDGET_TX_PCT + CONFIG_WLCON_MEM_BUDGET_RX_PCT >= 100
+#error "WLCON_MEM_BUDGET_TX_PCT + WLCON_MEM_BUDGET_RX_PCT must be less than 100"
+#endif
+
+#if CONFIG_WLCON_MEM_TX_BLOCK
+#define MBUDGET_TX_POLICY MBUDGET_BLOCK
+#elif CONFIG_WLCON_MEM_TX_DROP_OLDEST
+#define MBUDGET_TX_POLICY MBUDGET_DROP_OLDEST
+#else
+#define MBUDGET_TX_POLICY MBUDGET_BACKPRESSURE
+#endif
+
+#if CONFIG_WLCON_MEM_RX_BLOCK
+#define MBUDGET_RX_POLICY MBUDGET_BLOCK
+#elif CONFIG_WLCON_MEM_RX_DROP_OLDEST
+#define MBUDGET_RX_POLICY MBUDGET_DROP_OLDEST
+#else
+#define MBUDGET_RX_POLICY MBUDGET_BACKPRESSURE
+#endif
+
+// 记录栈使用量的常驻任务数量上限
+#define MBUDGET_TASK_MAX 8
+
+static const char *TAG = "mbudget";
+
+typedef struct
+{
+    mbudget_stats_t stats;
+    mbudget_policy_t policy;
+    SemaphoreHandle_t space; // BLOCK策略：释放额度时通知等待者
+#if configSUPPORT_STATIC_ALLOCATION
+    StaticSemaphore_t space_buf;
+#endif
+} mbudget_stage_state_t;
+
+typedef struct
+{
+    const char *name;
+    TaskHandle_t handle;
+    uint32_t depth;
+} mbudget_task_t;
+
+static mbudget_stage_state_t stages[MBUDGET_STAGE_MAX];
+static mbudget_task_t tasks[MBUDGET_TASK_MAX];
+static int task_count = 0;
+
+/**
+ * @brief 按配置划分三个阶段的额度
+ *
+ * 无线接收回调阶段只能立即拒绝：回调运行在WiFi任务中，不能等待，也不应替连接管理任务丢弃数据。
+ */
+esp_err_t mbudget_init(void)
+{
+    const uint32_t total = CONFIG_WLCON_MEM_BUDGET;
+    memset(stages, 0, sizeof(stages));
+    stages[MBUDGET_TX].stats.limit = total * CONFIG_WLCON_MEM_BUDGET_TX_PCT / 100;
+    stages[MBUDGET_RX].stats.limit = total * CONFIG_WLCON_MEM_BUDGET_RX_PCT / 100;
+    stages[MBUDGET_CB].stats.limit = total - stages[MBUDGET_TX].stats.limit - stages[MBUDGET_RX].stats.limit;
+    stages[MBUDGET_TX].policy = MBUDGET_TX_POLICY;
+    stages[MBUDGET_RX].policy = MBUDGET_RX_POLICY;
+    stages[MBUDGET_CB].policy = MBUDGET_BACKPRESSURE;
+    for (int i = 0; i < MBUDGET_STAGE_MAX; i++)
+    {
+        mbudget_stage_state_t *s = &stages[i];
+        if (s->policy != MBUDGET_BLOCK)
+            continue;
+#if configSUPPORT_STATIC_ALLOCATION
+        s->space = xSemaphoreCreateBinaryStatic(&s->space_buf);
+#else
+        s->space = xSemaphoreCreateBinary();
+#endif
+        if (s->space == NULL)
+        {
+            ESP_LOGE(TAG, "Create semaphore fail");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+mbudget_policy_t mbudget_policy(mbudget_stage_t stage)
+{
+    return stages[stage].policy;
+}
+
+/**
+ * @brief 申请额度
+ *
+ * 阶段为空时总是接收，单个超过额度的缓冲区不会永远等待。只有BLOCK策略的阶段会等待，
+ * 其余阶段ticks_to_wait不起作用。失败不计入统计，由调用者按策略处理后调用mbudget_reject。
+ */
+bool mbudget_acquire(mbudget_stage_t stage, uint32_t bytes, TickType_t ticks_to_wait)
+{
+    mbudget_stage_state_t *s = &stages[stage];
+    TickType_t start = xTaskGetTickCount();
+    while (1)
+    {
+        bool ok;
+        portENTER_CRITICAL();
+        ok = s->stats.used == 0 || s->stats.used + bytes <= s->stats.limit;
+        if (ok)
+        {
+            s->stats.used += bytes;
+            if (s->stats.used > s->stats.high_water)
+                s->stats.high_water = s->stats.used;
+        }
+        portEXIT_CRITICAL();
+        if (ok)
+            return true;
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (s->space == NULL || elapsed >= ticks_to_wait)
+            return false;
+        xSemaphoreTake(s->space, ticks_to_wait - elapsed);
+    }
+}
+
+void mbudget_release(mbudget_stage_t stage, uint32_t bytes)
+{
+    mbudget_stage_state_t *s = &stages[stage];
+    portENTER_CRITICAL();
+    s->stats.used = bytes < s->stats.used ? s->stats.used - bytes : 0;
+    portEXIT_CRITICAL();
+    if (s->space != NULL)
+        xSemaphoreGive(s->space);
+}
+
+// 释放被丢弃的缓冲区的额度
+void mbudget_drop(mbudget_stage_t stage, uint32_t bytes)
+{
+    portENTER_CRITICAL();
+    stages[stage].stats.dropped++;
+    portEXIT_CRITICAL();
+    mbudget_release(stage, bytes);
+}
+
+void mbudget_reject(mbudget_stage_t stage)
+{
+    portENTER_CRITICAL();
+    stages[stage].stats.rejected++;
+    portEXIT_CRITICAL();
+}
+
+uint32_t mbudget_available(mbudget_stage_t stage)
+{
+    const mbudget_stats_t *st = &stages[stage].stats;
+    uint32_t used = st->used;
+    return used < st->limit ? st->limit - used : 0;
+}
+
+void mbudget_get_stats(mbudget_stage_t stage, mbudget_stats_t *stats)
+{
+    portENTER_CRITICAL();
+    *stats = stages[stage].stats;
+    portEXIT_CRITICAL();
+}
+
+/**
+ * @brief 创建常驻任务并记录，用于报告栈的最高使用量
+ *
+ * 一般通过MBUDGET_TASK_CREATE调用。记录的任务不能删除自身。
+ */
+TaskHandle_t mbudget_task_create(TaskFunction_t fn, const char *name, uint32_t depth, void *arg,
+                                 UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb)
+{
+    TaskHandle_t handle = NULL;
+#if configSUPPORT_STATIC_ALLOCATION
+    handle = xTaskCreateStatic(fn, name, depth, arg, priority, stack, tcb);
+#else
+    (void)stack;
+    (void)tcb;
+    if (xTaskCreate(fn, name, depth, arg, priority, &handle) != pdPASS)
+        handle = NULL;
+#endif
+    if (handle == NULL)
+    {
+        ESP_LOGE(TAG, "Create task %s fail", name);
+        return NULL;
+    }
+    portENTER_CRITICAL();
+    if (task_count < MBUDGET_TASK_MAX)
+    {
+        tasks[task_count].name = name;
+        tasks[task_count].handle = handle;
+        tasks[task_count].depth = depth;
+        task_count++;
+    }
+    portEXIT_CRITICAL();
+    return handle;
+}
+
+// 输出各阶段额度与任务栈的使用情况，用于调整CONFIG_WLCON_MEM_BUDGET与栈大小
+void mbudget_log_report(void)
+{
+    static const char *stage_names[MBUDGET_STAGE_MAX] = {"tx", "rx", "cb"};
+    mbudget_stats_t st;
+    for (int i = 0; i < MBUDGET_STAGE_MAX; i++)
+    {
+        mbudget_get_stats(i, &st);
+        ESP_LOGI(TAG, "%s: used %u, high water %u of %u bytes, dropped %u, rejected %u",
+                 stage_names[i], st.used, st.high_water, st.limit, st.dropped, st.rejected);
+    }
+    for (int i = 0; i < task_count; i++)
+    {
+        ESP_LOGI(TAG, "task %s: stack %u, min free %u", tasks[i].name, tasks[i].depth,
+                 (uint32_t)uxTaskGetStackHighWaterMark(tasks[i].handle));
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef __MBUDGET_H__
+#define __MBUDGET_H__
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "sdkconfig.h"
+
+/*
+ * 内存预算：CONFIG_WLCON_MEM_BUDGET按比例分给发送(串口到无线)、接收(无线到串口)和
+ * 无线接收回调三个阶段，队列中缓存的数据按字节计入所属阶段，超出额度时按阶段的溢出策略处理。
+ * 桥接使用的队列和常驻任务静态分配，额度与任务栈的最高使用量可以随时查询。
+ */
+
+typedef enum
+{
+    MBUDGET_TX = 0, // 串口输入，等待无线发送
+    MBUDGET_RX,     // 无线收到，等待串口输出
+    MBUDGET_CB,     // 无线接收回调复制的帧，等待连接管理任务处理
+    MBUDGET_STAGE_MAX,
+} mbudget_stage_t;
+
+typedef enum
+{
+    MBUDGET_BLOCK,        // 等待额度释放，超时后拒绝
+    MBUDGET_DROP_OLDEST,  // 丢弃队列中最早的数据腾出额度
+    MBUDGET_BACKPRESSURE, // 立即拒绝，由上游暂停(不读取串口/回复忙让对端重传)
+} mbudget_policy_t;
+
+// 每个缓冲区额外计入的堆块头和队列元素开销
+#define MBUDGET_OVERHEAD 16
+#define MBUDGET_CHARGE(len) ((uint32_t)(len) + MBUDGET_OVERHEAD)
+
+typedef struct
+{
+    uint32_t limit;      // 额度(字节)
+    uint32_t used;       // 当前使用
+    uint32_t high_water; // 最高使用
+    uint32_t dropped;    // 按DROP_OLDEST丢弃的缓冲区
+    uint32_t rejected;   // 额度不足被拒绝的缓冲区
+} mbudget_stats_t;
+
+esp_err_t mbudget_init(void);
+mbudget_policy_t mbudget_policy(mbudget_stage_t stage);
+bool mbudget_acquire(mbudget_stage_t stage, uint32_t bytes, TickType_t ticks_to_wait);
+void mbudget_release(mbudget_stage_t stage, uint32_t bytes);
+void mbudget_drop(mbudget_stage_t stage, uint32_t bytes);
+void mbudget_reject(mbudget_stage_t stage);
+uint32_t mbudget_available(mbudget_stage_t stage);
+void mbudget_get_stats(mbudget_stage_t stage, mbudget_stats_t *stats);
+void mbudget_log_report(void);
+
+TaskHandle_t mbudget_task_create(TaskFunction_t fn, const char *name, uint32_t depth, void *arg,
+                                 UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb);
+
+/*
+ * 静态任务与队列。MBUDGET_TASK_DEFINE在文件作用域定义栈和控制块，任务函数与name同名，
+ * depth与xTaskCreate的栈深度单位相同；MBUDGET_QUEUE_DEFINE定义队列的存储区。
+ * FreeRTOS未开启静态分配时退回到动态创建。
+ */
+#if configSUPPORT_STATIC_ALLOCATION
+#define MBUDGET_TASK_DEFINE(name, depth) \
+    static StackType_t name##_stack[depth]; \
+    static StaticTask_t name##_tcb
+#define MBUDGET_TASK_CREATE(name, arg, priority) \
+    mbudget_task_create(name, #name, sizeof(name##_stack) / sizeof(StackType_t), arg, priority, name##_stack, &name##_tcb)
+#define MBUDGET_QUEUE_DEFINE(name, length, item_size) \
+    static uint8_t name##_storage[(length) * (item_size)]; \
+    static StaticQueue_t name##_qcb
+#define MBUDGET_QUEUE_CREATE(name, length, item_size) \
+    xQueueCreateStatic(length, item_size, name##_storage, &name##_qcb)
+#else
+#define MBUDGET_TASK_DEFINE(name, depth) \
+    enum { name##_depth = (depth) }
+#define MBUDGET_TASK_CREATE(name, arg, priority) \
+    mbudget_task_create(name, #name, name##_depth, arg, priority, NULL, NULL)
+#define MBUDGET_QUEUE_DEFINE(name, length, item_size) \
+    enum { name##_length = (length) }
+#define MBUDGET_QUEUE_CREATE(name, length, item_size) \
+    xQueueCreate(length, item_size)
+#endif
+#endif
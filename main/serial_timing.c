@@ -0,0 +1,76 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "serial_timing.h"
+
+/**
+ * @brief 编码一个数据字节
+ *
+ * @return 写入out的字节数
+ */
+size_t timing_put_byte(uint8_t *out, uint8_t byte)
+{
+    out[0] = byte;
+    if (byte != TIMING_ESC)
+    {
+        return 1;
+    }
+    out[1] = 0x00;
+    return 2;
+}
+
+/**
+ * @brief 编码一段空闲间隔，超过TIMING_GAP_MAX_US的间隔按最大值编码
+ *
+ * @return 写入out的字节数，不足一个计时单位的间隔不编码
+ */
+size_t timing_put_gap(uint8_t *out, uint32_t gap_us)
+{
+    uint32_t units = (gap_us + TIMING_GAP_UNIT_US / 2) / TIMING_GAP_UNIT_US;
+    if (units == 0)
+    {
+        return 0;
+    }
+    out[0] = TIMING_ESC;
+    out[1] = units > 255 ? 255 : (uint8_t)units;
+    return 2;
+}
+
+/**
+ * @brief 解码到下一个间隔为止
+ *
+ * @param in 编码后的数据
+ * @param len in的长度
+ * @param out 解码出的数据字节，容量不小于len
+ * @param out_len 解码出的数据长度
+ * @param gap_us 数据之后的空闲间隔，没有遇到间隔时为0
+ *
+ * @return 消耗的输入字节数
+ */
+size_t timing_decode(const uint8_t *in, size_t len, uint8_t *out, size_t *out_len, uint32_t *gap_us)
+{
+    size_t i = 0;
+    *out_len = 0;
+    *gap_us = 0;
+    while (i < len)
+    {
+        if (in[i] != TIMING_ESC)
+        {
+            out[(*out_len)++] = in[i++];
+            continue;
+        }
+        // 残缺的转义序列直接丢弃
+        if (i + 1 >= len)
+        {
+            return len;
+        }
+        if (in[i + 1] == 0x00)
+        {
+            out[(*out_len)++] = TIMING_ESC;
+            i += 2;
+            continue;
+        }
+        *gap_us = in[i + 1] * TIMING_GAP_UNIT_US;
+        return i + 2;
+    }
+    return i;
+}
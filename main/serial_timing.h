@@ -0,0 +1,17 @@
+#ifndef __SERIAL_TIMING_H__
+#define __SERIAL_TIMING_H__
+#include <stddef.h>
+#include <stdint.h>
+
+// 转义字节，后跟0x00表示数据0xFF，后跟1~255表示一段空闲间隔
+#define TIMING_ESC 0xFF
+// 间隔的计时单位(us)
+#define TIMING_GAP_UNIT_US 100
+#define TIMING_GAP_MAX_US (TIMING_GAP_UNIT_US * 255)
+// 单个数据字节或单个间隔编码后的最大长度
+#define TIMING_TOKEN_MAX_LEN 2
+
+size_t timing_put_byte(uint8_t *out, uint8_t byte);
+size_t timing_put_gap(uint8_t *out, uint32_t gap_us);
+size_t timing_decode(const uint8_t *in, size_t len, uint8_t *out, size_t *out_len, uint32_t *gap_us);
+#endif
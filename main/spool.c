@@ -0,0 +1,388 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "wlcon.h"
+#include "spool.h"
+
+#if CONFIG_WLCON_SPOOL
+#define SPOOL_RECORD_MAX_LEN WIRELESS_PACKET_MAX_PAYLOAD_SIZE
+#define SPOOL_SECTOR_SIZE 4096
+#define SPOOL_FLASH_MAGIC 0x5350
+#define SPOOL_ALIGN4(x) (((x) + 3) & ~3U)
+#define SPOOL_ROUNDUP_SECTOR(x) (((x) + SPOOL_SECTOR_SIZE - 1) / SPOOL_SECTOR_SIZE * SPOOL_SECTOR_SIZE)
+
+static const char *TAG = "spool";
+
+// 内存中的记录头
+typedef struct
+{
+    uint32_t time; // 写入时间(s)
+    uint16_t len;
+} __attribute__((packed)) ram_record_t;
+
+// flash中的记录头，记录不跨扇区，扇区剩余空间不足时跳到下一个扇区开头
+typedef struct
+{
+    uint16_t magic;
+    uint16_t len;
+    uint32_t time;
+} flash_record_t;
+
+static spool_stats_t spool_stats = {0};
+
+// 内存环形缓冲区，最早的数据在ram_head
+static uint8_t *ram_buf = NULL;
+static size_t ram_head = 0, ram_used = 0;
+
+// flash环形日志，偏移单调递增，访问分区时对分区大小取模
+static const esp_partition_t *spool_part = NULL;
+static uint32_t flash_rd = 0, flash_wr = 0;
+static uint8_t *flash_io_buf = NULL;
+
+// 放回的记录，早于内存和flash中的所有记录。后放回的先取出，可以在连接管理任务中写入，临界区内交接
+typedef struct
+{
+    uint8_t *buf;
+    uint16_t len;
+    uint32_t time;
+} front_record_t;
+
+static front_record_t front[SPOOL_FRONT_MAX];
+static int front_count = 0;
+
+static inline uint32_t spool_now(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static void ram_write(const void *src, size_t len)
+{
+    size_t tail = (ram_head + ram_used) % CONFIG_WLCON_SPOOL_RAM_SIZE;
+    size_t first = CONFIG_WLCON_SPOOL_RAM_SIZE - tail;
+    if (first > len)
+        first = len;
+    memcpy(ram_buf + tail, src, first);
+    memcpy(ram_buf, (const uint8_t *)src + first, len - first);
+    ram_used += len;
+}
+
+static void ram_read(void *dst, size_t len)
+{
+    size_t first = CONFIG_WLCON_SPOOL_RAM_SIZE - ram_head;
+    if (first > len)
+        first = len;
+    if (dst != NULL)
+    {
+        memcpy(dst, ram_buf + ram_head, first);
+        memcpy((uint8_t *)dst + first, ram_buf, len - first);
+    }
+    ram_head = (ram_head + len) % CONFIG_WLCON_SPOOL_RAM_SIZE;
+    ram_used -= len;
+}
+
+static void ram_peek(ram_record_t *rec)
+{
+    size_t first = CONFIG_WLCON_SPOOL_RAM_SIZE - ram_head;
+    if (first > sizeof(*rec))
+        first = sizeof(*rec);
+    memcpy(rec, ram_buf + ram_head, first);
+    memcpy((uint8_t *)rec + first, ram_buf, sizeof(*rec) - first);
+}
+
+// 取出内存中最早的一条记录，dst为NULL时直接丢弃
+static size_t ram_pop(uint32_t *time, uint8_t *dst)
+{
+    ram_record_t rec;
+    ram_read(&rec, sizeof(rec));
+    ram_read(dst, rec.len);
+    *time = rec.time;
+    return rec.len;
+}
+
+/**
+ * @brief 丢弃flash中最早的一个扇区
+ *
+ * 逐条解析以统计丢弃的记录数。
+ */
+static void flash_drop_sector(void)
+{
+    uint32_t end = flash_rd / SPOOL_SECTOR_SIZE * SPOOL_SECTOR_SIZE + SPOOL_SECTOR_SIZE;
+    flash_record_t rec;
+    while (flash_rd < end && flash_rd != flash_wr)
+    {
+        if (end - flash_rd < sizeof(rec) ||
+            esp_partition_read(spool_part, flash_rd % spool_part->size, &rec, sizeof(rec)) != ESP_OK ||
+            rec.magic != SPOOL_FLASH_MAGIC)
+        {
+            break;
+        }
+        spool_stats.dropped++;
+        flash_rd += SPOOL_ALIGN4(sizeof(rec) + rec.len);
+    }
+    flash_rd = end < flash_wr ? end : flash_wr;
+}
+
+// 把一条记录追加到flash日志
+static bool flash_append(uint32_t time, const uint8_t *data, size_t len)
+{
+    size_t rec_len = SPOOL_ALIGN4(sizeof(flash_record_t) + len);
+    uint32_t wr = flash_wr;
+    if (SPOOL_SECTOR_SIZE - wr % SPOOL_SECTOR_SIZE < rec_len)
+    {
+        wr = SPOOL_ROUNDUP_SECTOR(wr);
+    }
+    if (wr % SPOOL_SECTOR_SIZE == 0)
+    {
+        // 进入新扇区前需要擦除，不能覆盖未读取的数据
+        while (wr + SPOOL_SECTOR_SIZE - flash_rd > spool_part->size)
+        {
+#if CONFIG_WLCON_SPOOL_DROP_OLDEST
+            flash_drop_sector();
+#else
+            return false;
+#endif
+        }
+        if (esp_partition_erase_range(spool_part, wr % spool_part->size, SPOOL_SECTOR_SIZE) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Erase spool sector fail");
+            return false;
+        }
+    }
+    flash_record_t *rec = (flash_record_t *)flash_io_buf;
+    rec->magic = SPOOL_FLASH_MAGIC;
+    rec->len = len;
+    rec->time = time;
+    memmove(flash_io_buf + sizeof(flash_record_t), data, len);
+    if (esp_partition_write(spool_part, wr % spool_part->size, flash_io_buf, rec_len) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Write spool record fail");
+        return false;
+    }
+    // 读指针与写指针相同时跳过的空间也一起跳过
+    if (flash_rd == flash_wr)
+        flash_rd = wr;
+    flash_wr = wr + rec_len;
+    spool_stats.spilled++;
+    return true;
+}
+
+// 取出flash中最早的一条记录
+static size_t flash_pop(uint32_t *time, uint8_t *dst)
+{
+    flash_record_t rec;
+    while (flash_rd != flash_wr)
+    {
+        if (SPOOL_SECTOR_SIZE - flash_rd % SPOOL_SECTOR_SIZE < sizeof(rec) ||
+            esp_partition_read(spool_part, flash_rd % spool_part->size, &rec, sizeof(rec)) != ESP_OK ||
+            rec.magic != SPOOL_FLASH_MAGIC || rec.len > SPOOL_RECORD_MAX_LEN)
+        {
+            // 扇区末尾的空白
+            flash_rd = SPOOL_ROUNDUP_SECTOR(flash_rd + 1);
+            if (flash_rd > flash_wr)
+                flash_rd = flash_wr;
+            continue;
+        }
+        esp_err_t ret = esp_partition_read(spool_part, (flash_rd + sizeof(rec)) % spool_part->size, dst, rec.len);
+        flash_rd += SPOOL_ALIGN4(sizeof(rec) + rec.len);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Read spool record fail");
+            spool_stats.dropped++;
+            continue;
+        }
+        *time = rec.time;
+        return rec.len;
+    }
+    return 0;
+}
+
+/**
+ * @brief 初始化存储转发缓冲区
+ *
+ * 找不到spool分区或未开启flash转存时只使用内存缓冲区。日志只在本次上电内有效，启动时视为空。
+ */
+esp_err_t spool_init(void)
+{
+    ram_buf = malloc(CONFIG_WLCON_SPOOL_RAM_SIZE);
+    if (ram_buf == NULL)
+    {
+        ESP_LOGE(TAG, "Malloc spool buffer fail");
+        return ESP_ERR_NO_MEM;
+    }
+#if CONFIG_WLCON_SPOOL_FLASH
+    spool_part = esp_partition_find_first(SPOOL_PARTITION_TYPE, SPOOL_PARTITION_SUBTYPE, NULL);
+    if (spool_part == NULL || spool_part->size < 2 * SPOOL_SECTOR_SIZE)
+    {
+        ESP_LOGW(TAG, "No spool partition, RAM only");
+        spool_part = NULL;
+        return ESP_OK;
+    }
+    flash_io_buf = malloc(SPOOL_ALIGN4(sizeof(flash_record_t) + SPOOL_RECORD_MAX_LEN));
+    if (flash_io_buf == NULL)
+    {
+        ESP_LOGE(TAG, "Malloc spool io buffer fail");
+        spool_part = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Spool partition %d KB", spool_part->size / 1024);
+#endif
+    return ESP_OK;
+}
+
+/**
+ * @brief 缓存一条断线期间的串口数据
+ *
+ * 内存缓冲区满时先把最早的记录转存到flash，flash也满(或没有flash)时按溢出策略丢弃最早或最新的数据。
+ *
+ * @return false 数据被丢弃
+ */
+bool spool_put(const uint8_t *data, size_t len)
+{
+    uint32_t time;
+    size_t need = sizeof(ram_record_t) + len;
+    if (ram_buf == NULL || len == 0 || len > SPOOL_RECORD_MAX_LEN || need > CONFIG_WLCON_SPOOL_RAM_SIZE)
+    {
+        return false;
+    }
+    while (CONFIG_WLCON_SPOOL_RAM_SIZE - ram_used < need)
+    {
+        if (spool_part != NULL)
+        {
+            // 只转存最早的记录，保证flash中的数据总是早于内存中的数据；转存失败时恢复内存中的记录
+            uint8_t *tmp = flash_io_buf + sizeof(flash_record_t);
+            size_t saved_head = ram_head, saved_used = ram_used;
+            size_t old_len = ram_pop(&time, tmp);
+            if (!flash_append(time, tmp, old_len))
+            {
+                ram_head = saved_head;
+                ram_used = saved_used;
+                spool_stats.dropped++;
+                return false;
+            }
+        }
+        else
+        {
+#if CONFIG_WLCON_SPOOL_DROP_OLDEST
+            ram_pop(&time, NULL);
+            spool_stats.dropped++;
+#else
+            spool_stats.dropped++;
+            return false;
+#endif
+        }
+    }
+    ram_record_t rec = {
+        .time = spool_now(),
+        .len = len,
+    };
+    ram_write(&rec, sizeof(rec));
+    ram_write(data, len);
+    spool_stats.stored++;
+    return true;
+}
+
+/**
+ * @brief 把已取出但未送达的一条数据放回最前面，下一次spool_get首先取出
+ *
+ * 用于发送队列不接收的补发数据和断线时尚未送达的数据帧。多条数据按从新到旧的顺序放回，
+ * 取出时恢复原来的顺序。最多保留SPOOL_FRONT_MAX条，已满或内存不足时返回false，数据未被接收。
+ */
+bool spool_put_front(const uint8_t *data, size_t len)
+{
+    bool ok;
+    if (ram_buf == NULL || len == 0 || len > SPOOL_RECORD_MAX_LEN)
+    {
+        return false;
+    }
+    uint8_t *buf = malloc(len);
+    if (buf == NULL)
+    {
+        return false;
+    }
+    memcpy(buf, data, len);
+    portENTER_CRITICAL();
+    ok = front_count < SPOOL_FRONT_MAX;
+    if (ok)
+    {
+        front[front_count].buf = buf;
+        front[front_count].len = len;
+        front[front_count].time = spool_now();
+        front_count++;
+        spool_stats.stored++;
+    }
+    portEXIT_CRITICAL();
+    if (!ok)
+        free(buf);
+    return ok;
+}
+
+/**
+ * @brief 按写入顺序取出一条缓存的数据，超过保留时间的数据直接丢弃
+ *
+ * @return 数据长度，0表示没有缓存数据
+ */
+size_t spool_get(uint8_t *buf, size_t cap)
+{
+    uint32_t time;
+    size_t len;
+    while (!spool_is_empty())
+    {
+        if (front_count != 0)
+        {
+            front_record_t rec;
+            portENTER_CRITICAL();
+            rec = front[--front_count];
+            portEXIT_CRITICAL();
+            len = rec.len;
+            time = rec.time;
+            if (len <= cap)
+                memcpy(buf, rec.buf, len);
+            free(rec.buf);
+        }
+        else if (spool_part != NULL && flash_rd != flash_wr)
+        {
+            len = flash_pop(&time, flash_io_buf);
+            if (len == 0)
+                continue;
+            if (len <= cap)
+                memcpy(buf, flash_io_buf, len);
+        }
+        else
+        {
+            ram_record_t rec;
+            ram_peek(&rec);
+            len = ram_pop(&time, rec.len <= cap ? buf : NULL);
+        }
+        if (len > cap)
+        {
+            spool_stats.dropped++;
+            continue;
+        }
+        if (CONFIG_WLCON_SPOOL_RETENTION_S > 0 && spool_now() - time > CONFIG_WLCON_SPOOL_RETENTION_S)
+        {
+            spool_stats.expired++;
+            continue;
+        }
+        spool_stats.drained++;
+        return len;
+    }
+    return 0;
+}
+
+bool spool_is_empty(void)
+{
+    return front_count == 0 && ram_used == 0 && (spool_part == NULL || flash_rd == flash_wr);
+}
+
+void spool_get_stats(spool_stats_t *stats)
+{
+    *stats = spool_stats;
+}
+#endif
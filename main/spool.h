@@ -0,0 +1,30 @@
+#ifndef __SPOOL_H__
+#define __SPOOL_H__
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// 存储转发分区的类型，见partitions.csv
+#define SPOOL_PARTITION_TYPE 0x40
+#define SPOOL_PARTITION_SUBTYPE 0x00
+// 放回最前面的记录数上限：断线时数据通道发送队列中的帧、等待应答的一帧和补发时被拒绝的一帧
+#define SPOOL_FRONT_MAX (CONFIG_WLCON_IO_QUEUE_SIZE + 2)
+
+typedef struct
+{
+    uint32_t stored;   // 写入的记录数
+    uint32_t drained;  // 取出的记录数
+    uint32_t dropped;  // 因溢出丢弃的记录数
+    uint32_t expired;  // 超过保留时间丢弃的记录数
+    uint32_t spilled;  // 从内存转存到flash的记录数
+} spool_stats_t;
+
+esp_err_t spool_init(void);
+bool spool_put(const uint8_t *data, size_t len);
+bool spool_put_front(const uint8_t *data, size_t len);
+size_t spool_get(uint8_t *buf, size_t cap);
+bool spool_is_empty(void);
+void spool_get_stats(spool_stats_t *stats);
+#endif
@@ -0,0 +1,38 @@
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// 对端地址长度：ESP-NOW为MAC地址，UDP为IPv4地址(4字节)+端口(2字节，大端)
+#define WLCON_ADDR_LEN 6
+
+#if CONFIG_WLCON_TRANSPORT_UDP
+#define WLCON_TRANSPORT_MTU CONFIG_WLCON_UDP_MTU
+#else
+#define WLCON_TRANSPORT_MTU 250 // ESP_NOW_MAX_DATA_LEN
+#endif
+
+// 发送完成回调，success表示数据已交给对端(ESP-NOW)或已交给协议栈(UDP)
+typedef void (*transport_send_cb_t)(const uint8_t *addr, bool success);
+// 接收回调，data在回调返回后失效
+typedef void (*transport_recv_cb_t)(const uint8_t *addr, const uint8_t *data, int len);
+
+// 无线传输接口，连接管理只通过此接口收发数据
+typedef struct
+{
+    const char *name;
+    size_t mtu; // 单帧最大长度
+    esp_err_t (*init)(transport_send_cb_t send_cb, transport_recv_cb_t recv_cb);
+    esp_err_t (*send)(const uint8_t *addr, const uint8_t *data, size_t len);
+    esp_err_t (*add_peer)(const uint8_t *addr, bool encrypt);
+    esp_err_t (*del_peer)(const uint8_t *addr);
+    bool (*is_peer_exist)(const uint8_t *addr);
+    esp_err_t (*set_channel)(uint8_t channel); // 不支持切换信道时为NULL
+} wlcon_transport_t;
+
+extern const wlcon_transport_t transport_espnow;
+extern const wlcon_transport_t transport_udp;
+#endif
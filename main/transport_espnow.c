@@ -0,0 +1,93 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include "wlcon.h"
+#include "transport.h"
+
+static const char *TAG = "transport_espnow";
+
+static uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static transport_send_cb_t espnow_send_handler = NULL;
+static transport_recv_cb_t espnow_recv_handler = NULL;
+
+static void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+    if (espnow_send_handler != NULL)
+        espnow_send_handler(mac_addr, status == ESP_NOW_SEND_SUCCESS);
+}
+
+static void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    if (espnow_recv_handler != NULL)
+        espnow_recv_handler(mac_addr, data, len);
+}
+
+static esp_err_t espnow_add_peer(const uint8_t *addr, bool encrypt)
+{
+    esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
+    if (peer == NULL)
+    {
+        ESP_LOGE(TAG, "Malloc peer information fail");
+        return ESP_ERR_NO_MEM;
+    }
+    memset(peer, 0, sizeof(esp_now_peer_info_t));
+    // 0表示使用当前信道，信道切换后无需修改peer
+    peer->channel = 0;
+    peer->ifidx = ESPNOW_WIFI_IF;
+    peer->encrypt = encrypt;
+    if (encrypt)
+        memcpy(peer->lmk, CONFIG_ESPNOW_LMK, ESP_NOW_KEY_LEN);
+    memcpy(peer->peer_addr, addr, ESP_NOW_ETH_ALEN);
+    esp_err_t ret = esp_now_add_peer(peer);
+    free(peer);
+    return ret;
+}
+
+static esp_err_t espnow_init(transport_send_cb_t send_cb, transport_recv_cb_t recv_cb)
+{
+    espnow_send_handler = send_cb;
+    espnow_recv_handler = recv_cb;
+    ESP_ERROR_CHECK(esp_now_init());
+    ESP_ERROR_CHECK(esp_now_register_send_cb(espnow_send_cb));
+    ESP_ERROR_CHECK(esp_now_register_recv_cb(espnow_recv_cb));
+    ESP_ERROR_CHECK(esp_now_set_pmk((uint8_t *)CONFIG_ESPNOW_PMK));
+
+    // 添加广播地址为peer
+    esp_err_t ret = espnow_add_peer(broadcast_mac, false);
+    if (ret != ESP_OK)
+    {
+        esp_now_deinit();
+        return ret;
+    }
+    // 获取ESP_NOW版本
+    uint32_t esp_now_version;
+    esp_now_get_version(&esp_now_version);
+    ESP_LOGI(TAG, "ESP-NOW Version: %d", esp_now_version);
+    return ESP_OK;
+}
+
+static esp_err_t espnow_send(const uint8_t *addr, const uint8_t *data, size_t len)
+{
+    return esp_now_send(addr, data, len);
+}
+
+static esp_err_t espnow_set_channel(uint8_t channel)
+{
+    return esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+}
+
+const wlcon_transport_t transport_espnow = {
+    .name = "espnow",
+    .mtu = ESP_NOW_MAX_DATA_LEN,
+    .init = espnow_init,
+    .send = espnow_send,
+    .add_peer = espnow_add_peer,
+    .del_peer = esp_now_del_peer,
+    .is_peer_exist = esp_now_is_peer_exist,
+    .set_channel = espnow_set_channel,
+};
@@ -0,0 +1,147 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_wifi.h"
+#include "lwip/sockets.h"
+#include "wlcon.h"
+#include "transport.h"
+#include "mbudget.h"
+#include "udp_link.h"
+
+#if CONFIG_WLCON_TRANSPORT_UDP
+#if !CONFIG_WLCON_AEAD
+#error "WLCON_TRANSPORT_UDP requires WLCON_AEAD"
+#endif
+#define UDP_CONNECTED_BIT BIT0
+// 连接AP的最长等待时间
+#define UDP_CONNECT_TIMEOUT_MS 30000
+
+static const char *TAG = "transport_udp";
+
+static udp_link_t udp_link = {.sock = -1};
+static transport_send_cb_t udp_send_handler = NULL;
+static transport_recv_cb_t udp_recv_handler = NULL;
+static EventGroupHandle_t udp_event_group = NULL;
+
+static void udp_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
+    {
+        // AP断开后持续重连，上层的心跳超时会负责重新发现对端
+        xEventGroupClearBits(udp_event_group, UDP_CONNECTED_BIT);
+        esp_wifi_connect();
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    {
+        xEventGroupSetBits(udp_event_group, UDP_CONNECTED_BIT);
+    }
+}
+
+// 接收缓冲区，数据在接收回调中复制后即可复用
+static uint8_t udp_rx_buf[CONFIG_WLCON_UDP_MTU];
+MBUDGET_TASK_DEFINE(udp_rx_task, 2048);
+
+static void udp_rx_task(void *param)
+{
+    uint8_t addr[WLCON_ADDR_LEN];
+    while (1)
+    {
+        int len = udp_link_recv(&udp_link, addr, udp_rx_buf, sizeof(udp_rx_buf));
+        if (len <= 0)
+        {
+            ESP_LOGE(TAG, "recvfrom fail: %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        if (udp_recv_handler != NULL)
+            udp_recv_handler(addr, udp_rx_buf, len);
+    }
+}
+
+static esp_err_t udp_init(transport_send_cb_t send_cb, transport_recv_cb_t recv_cb)
+{
+    udp_send_handler = send_cb;
+    udp_recv_handler = recv_cb;
+
+    // 连接AP
+    udp_event_group = xEventGroupCreate();
+    if (udp_event_group == NULL)
+        return ESP_ERR_NO_MEM;
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &udp_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &udp_event_handler, NULL));
+    wifi_config_t wifi_config = {0};
+    strncpy((char *)wifi_config.sta.ssid, CONFIG_WLCON_UDP_SSID, sizeof(wifi_config.sta.ssid));
+    strncpy((char *)wifi_config.sta.password, CONFIG_WLCON_UDP_PASSWORD, sizeof(wifi_config.sta.password));
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+    esp_wifi_connect();
+    if (!(xEventGroupWaitBits(udp_event_group, UDP_CONNECTED_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(UDP_CONNECT_TIMEOUT_MS)) & UDP_CONNECTED_BIT))
+    {
+        ESP_LOGE(TAG, "Connect to AP %s timeout", CONFIG_WLCON_UDP_SSID);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    if (udp_link_open(&udp_link, INADDR_ANY, CONFIG_WLCON_UDP_PORT, INADDR_BROADCAST) != 0)
+    {
+        ESP_LOGE(TAG, "Open port %d fail: %d", CONFIG_WLCON_UDP_PORT, errno);
+        return ESP_FAIL;
+    }
+    if (MBUDGET_TASK_CREATE(udp_rx_task, NULL, CONFIG_WLCON_MANAGER_PRORITY + 1) == NULL)
+    {
+        udp_link_close(&udp_link);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "UDP transport on port %d", CONFIG_WLCON_UDP_PORT);
+    return ESP_OK;
+}
+
+static esp_err_t udp_send(const uint8_t *addr, const uint8_t *data, size_t len)
+{
+    if (len > CONFIG_WLCON_UDP_MTU || udp_link_send(&udp_link, addr, data, len) != 0)
+    {
+        return ESP_FAIL;
+    }
+    // UDP没有链路层确认，交给协议栈即视为发送完成
+    if (udp_send_handler != NULL)
+        udp_send_handler(addr, true);
+    return ESP_OK;
+}
+
+// UDP无需注册对端，也不提供链路层加密，数据由会话加密(CONFIG_WLCON_AEAD)保护
+static esp_err_t udp_add_peer(const uint8_t *addr, bool encrypt)
+{
+    if (encrypt)
+    {
+        ESP_LOGE(TAG, "UDP transport has no link encryption, enable WLCON_AEAD");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t udp_del_peer(const uint8_t *addr)
+{
+    return ESP_OK;
+}
+
+static bool udp_is_peer_exist(const uint8_t *addr)
+{
+    return false;
+}
+
+const wlcon_transport_t transport_udp = {
+    .name = "udp",
+    .mtu = CONFIG_WLCON_UDP_MTU,
+    .init = udp_init,
+    .send = udp_send,
+    .add_peer = udp_add_peer,
+    .del_peer = udp_del_peer,
+    .is_peer_exist = udp_is_peer_exist,
+    .set_channel = NULL,
+};
+#endif
@@ -0,0 +1,124 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "twheel.h"
+
+#define TWHEEL_MASK (TWHEEL_SLOTS - 1)
+
+void twheel_init(twheel_t *w, int64_t now_us)
+{
+    memset(w, 0, sizeof(*w));
+    w->last_tick = now_us / TWHEEL_TICK_US;
+}
+
+void twheel_timer_init(twheel_timer_t *t, twheel_cb_t cb, void *arg)
+{
+    memset(t, 0, sizeof(*t));
+    t->cb = cb;
+    t->arg = arg;
+}
+
+/**
+ * @brief 启动定时器，已启动的定时器按新的到期时间重新启动
+ *
+ * 到期时间向上取整到tick，定时器不会提前触发；已经过期的时间在下一次twheel_run时触发。
+ */
+void twheel_add(twheel_t *w, twheel_timer_t *t, int64_t expires_us)
+{
+    twheel_del(w, t);
+    int64_t tick = (expires_us + TWHEEL_TICK_US - 1) / TWHEEL_TICK_US;
+    if (tick <= w->last_tick)
+        tick = w->last_tick + 1;
+    twheel_timer_t **head = &w->slots[tick & TWHEEL_MASK];
+    t->tick = tick;
+    t->next = *head;
+    if (t->next != NULL)
+        t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+    w->count++;
+}
+
+void twheel_del(twheel_t *w, twheel_timer_t *t)
+{
+    if (t->pprev == NULL)
+        return;
+    *t->pprev = t->next;
+    if (t->next != NULL)
+        t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+    w->count--;
+}
+
+/**
+ * @brief 触发所有已到期的定时器
+ *
+ * 定时器先从时间轮中移除再回调，回调中可以重新启动自身或增删其他定时器。
+ *
+ * @return 触发的定时器数量
+ */
+int twheel_run(twheel_t *w, int64_t now_us)
+{
+    int64_t now_tick = now_us / TWHEEL_TICK_US;
+    int fired = 0;
+    if (w->count == 0)
+    {
+        if (now_tick > w->last_tick)
+            w->last_tick = now_tick;
+        return 0;
+    }
+    // 超过一圈时每个槽只需检查一次
+    if (now_tick - w->last_tick > TWHEEL_SLOTS)
+        w->last_tick = now_tick - TWHEEL_SLOTS;
+    while (w->last_tick < now_tick)
+    {
+        w->last_tick++;
+        twheel_timer_t *t = w->slots[w->last_tick & TWHEEL_MASK];
+        while (t != NULL)
+        {
+            if (t->tick > now_tick)
+            {
+                t = t->next;
+                continue;
+            }
+            twheel_del(w, t);
+            t->cb(t->arg);
+            fired++;
+            // 回调可能修改了链表，从头检查
+            t = w->slots[w->last_tick & TWHEEL_MASK];
+        }
+    }
+    return fired;
+}
+
+/**
+ * @brief 获取最早的到期时间(us)
+ *
+ * 先按顺序查找一圈之内到期的定时器，找不到时再比较所有定时器。
+ *
+ * @return 到期时间，没有定时器时为TWHEEL_NEVER
+ */
+int64_t twheel_next(const twheel_t *w)
+{
+    if (w->count == 0)
+        return TWHEEL_NEVER;
+    for (int64_t tick = w->last_tick + 1; tick <= w->last_tick + TWHEEL_SLOTS; tick++)
+    {
+        for (const twheel_timer_t *t = w->slots[tick & TWHEEL_MASK]; t != NULL; t = t->next)
+        {
+            if (t->tick == tick)
+                return tick * TWHEEL_TICK_US;
+        }
+    }
+    int64_t next = TWHEEL_NEVER;
+    for (int i = 0; i < TWHEEL_SLOTS; i++)
+    {
+        for (const twheel_timer_t *t = w->slots[i]; t != NULL; t = t->next)
+        {
+            if (t->tick < next)
+                next = t->tick;
+        }
+    }
+    return next * TWHEEL_TICK_US;
+}
@@ -0,0 +1,43 @@
+#ifndef __TWHEEL_H__
+#define __TWHEEL_H__
+#include <stdbool.h>
+#include <stdint.h>
+
+// 时间轮槽数，必须为2的幂
+#define TWHEEL_SLOTS 64
+// 时间轮精度(us)
+#define TWHEEL_TICK_US 1000
+// 没有定时器时twheel_next的返回值
+#define TWHEEL_NEVER INT64_MAX
+
+typedef void (*twheel_cb_t)(void *arg);
+
+// 定时器，由使用者分配，在时间轮中以链表串接
+typedef struct twheel_timer
+{
+    struct twheel_timer *next;
+    struct twheel_timer **pprev; // 未启动时为NULL
+    int64_t tick;                // 到期的tick
+    twheel_cb_t cb;
+    void *arg;
+} twheel_timer_t;
+
+typedef struct
+{
+    twheel_timer_t *slots[TWHEEL_SLOTS];
+    int64_t last_tick; // 已处理到的tick
+    uint32_t count;    // 已启动的定时器数量
+} twheel_t;
+
+void twheel_init(twheel_t *w, int64_t now_us);
+void twheel_timer_init(twheel_timer_t *t, twheel_cb_t cb, void *arg);
+void twheel_add(twheel_t *w, twheel_timer_t *t, int64_t expires_us);
+void twheel_del(twheel_t *w, twheel_timer_t *t);
+int twheel_run(twheel_t *w, int64_t now_us);
+int64_t twheel_next(const twheel_t *w);
+
+static inline bool twheel_pending(const twheel_timer_t *t)
+{
+    return t->pprev != NULL;
+}
+#endif
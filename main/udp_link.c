@@ -0,0 +1,119 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#else
+#include "lwip/sockets.h"
+#endif
+#include "udp_link.h"
+
+// 6字节地址与socket地址互相转换，广播地址换成bcast_ip和本地端口
+static void udp_addr_to_sockaddr(const udp_link_t *link, const uint8_t *addr, struct sockaddr_in *sa)
+{
+    memset(sa, 0, sizeof(*sa));
+    sa->sin_family = AF_INET;
+    memcpy(&sa->sin_addr.s_addr, addr, 4);
+    memcpy(&sa->sin_port, addr + 4, 2);
+    if (sa->sin_addr.s_addr == htonl(INADDR_BROADCAST))
+    {
+        sa->sin_addr.s_addr = htonl(link->bcast_ip);
+        sa->sin_port = htons(link->port);
+    }
+}
+
+static void udp_sockaddr_to_addr(const struct sockaddr_in *sa, uint8_t *addr)
+{
+    memcpy(addr, &sa->sin_addr.s_addr, 4);
+    memcpy(addr + 4, &sa->sin_port, 2);
+}
+
+// 由主机字节序的IPv4地址和端口生成6字节地址
+void udp_link_make_addr(uint32_t ip, uint16_t port, uint8_t *addr)
+{
+    struct sockaddr_in sa;
+    sa.sin_addr.s_addr = htonl(ip);
+    sa.sin_port = htons(port);
+    udp_sockaddr_to_addr(&sa, addr);
+}
+
+/**
+ * @brief 创建允许广播的UDP socket并绑定端口
+ *
+ * @param bind_ip 本地地址(主机字节序)，一般为INADDR_ANY
+ * @param port 本地端口，广播也发往此端口
+ * @param bcast_ip 广播的目的地址(主机字节序)，一般为INADDR_BROADCAST
+ *
+ * @return 0成功，-1失败，原因见errno
+ */
+int udp_link_open(udp_link_t *link, uint32_t bind_ip, uint16_t port, uint32_t bcast_ip)
+{
+    link->port = port;
+    link->bcast_ip = bcast_ip;
+    link->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (link->sock < 0)
+    {
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(link->sock, SOL_SOCKET, SO_BROADCAST, &opt, sizeof(opt));
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(bind_ip);
+    if (bind(link->sock, (struct sockaddr *)&local, sizeof(local)) < 0)
+    {
+        udp_link_close(link);
+        return -1;
+    }
+    return 0;
+}
+
+void udp_link_close(udp_link_t *link)
+{
+    if (link->sock >= 0)
+    {
+        close(link->sock);
+        link->sock = -1;
+    }
+}
+
+/**
+ * @brief 发送一个数据报
+ *
+ * @return 0成功，-1失败(包括只发出了一部分)
+ */
+int udp_link_send(const udp_link_t *link, const uint8_t *addr, const uint8_t *data, size_t len)
+{
+    struct sockaddr_in to;
+    udp_addr_to_sockaddr(link, addr, &to);
+    if (sendto(link->sock, data, len, 0, (struct sockaddr *)&to, sizeof(to)) != (int)len)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 阻塞接收一个数据报
+ *
+ * @param addr 发送方的6字节地址，可直接用于回复
+ *
+ * @return 数据报长度，-1失败
+ */
+int udp_link_recv(const udp_link_t *link, uint8_t *addr, uint8_t *buf, size_t size)
+{
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    int len = recvfrom(link->sock, buf, size, 0, (struct sockaddr *)&from, &from_len);
+    if (len < 0)
+    {
+        return -1;
+    }
+    udp_sockaddr_to_addr(&from, addr);
+    return len;
+}
@@ -0,0 +1,25 @@
+#ifndef __UDP_LINK_H__
+#define __UDP_LINK_H__
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * UDP收发与广播发现，只使用BSD socket接口：ESP8266上由lwIP提供，主机上使用系统socket，
+ * 可以在Linux回环地址上测试。对端地址为6字节：IPv4地址(4字节)+端口(2字节)，均为网络字节序，
+ * 全0xFF表示广播，发往bcast_ip的同一端口。
+ */
+#define UDP_LINK_ADDR_LEN 6
+
+typedef struct
+{
+    int sock;
+    uint16_t port;     // 本地端口，两端相同
+    uint32_t bcast_ip; // 广播的目的地址
+} udp_link_t;
+
+int udp_link_open(udp_link_t *link, uint32_t bind_ip, uint16_t port, uint32_t bcast_ip);
+void udp_link_close(udp_link_t *link);
+int udp_link_send(const udp_link_t *link, const uint8_t *addr, const uint8_t *data, size_t len);
+int udp_link_recv(const udp_link_t *link, uint8_t *addr, uint8_t *buf, size_t size);
+void udp_link_make_addr(uint32_t ip, uint16_t port, uint8_t *addr);
+#endif
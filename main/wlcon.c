@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,43 +21,125 @@
 #include "esp_system.h"
 #include "esp_now.h"
 #include "rom/ets_sys.h"
-#include "rom/crc.h"
 #include "wlcon.h"
 #include "driver/uart.h"
 #include "freertos/queue.h"
 #include "freertos/ringbuf.h"
 #include "esp_timer.h"
+#include "chanmgr.h"
+#include "twheel.h"
+#include "ascon.h"
+#include "crc16.h"
+#include "mbudget.h"
+#include "spool.h"
 
 #define CON_TYPE_RST 0x01
 #define CON_TYPE_ACK 0x02
 #define CON_TYPE_EST 0x03
 
+#define CHAN_TYPE_REQ 0x01
+#define CHAN_TYPE_ACK 0x02
+
+// 数据应答包的负载：接收额度不足，数据未接收
+#define DATA_ACK_BUSY 0x01
+#if CONFIG_WLCON_AEAD
+// 连接请求/应答包携带的随机数，连接建立包携带的密钥确认码
+#define CONNECT_EXTRA_LEN 8
+#else
+#define CONNECT_EXTRA_LEN 0
+#endif
+// 启动扫描时最多记录的AP数量
+#define CHANNEL_SCAN_MAX_AP 32
+// 心跳超时比心跳间隔多一秒
+#define HEARTBEAT_TIMEOUT_US ((CONFIG_HEARTBEAT_INTERVAL + 1000) * 1000LL)
+
 static const char *TAG = "Serial_ESPNow";
 
-static uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-static uint8_t target_mac[ESP_NOW_ETH_ALEN] = {0xff};
+static uint8_t broadcast_mac[WLCON_ADDR_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static uint8_t target_mac[WLCON_ADDR_LEN] = {0xff};
+
+// 无线传输层
+#if CONFIG_WLCON_TRANSPORT_UDP
+static const wlcon_transport_t *transport = &transport_udp;
+#else
+static const wlcon_transport_t *transport = &transport_espnow;
+#endif
+
+// 单帧可承载的串口数据长度，由传输层的MTU决定，wlcon_init保证不超过WIRELESS_PACKET_MAX_PAYLOAD_SIZE
+static inline size_t wlcon_max_payload(void)
+{
+    return transport->mtu - sizeof(wireless_packet_t) - WLCON_AEAD_OVERHEAD;
+}
 
 // 是否作为主机
 static bool is_master = false;
 // 无线通信状态
 wireless_status_t status = WIRELESS_STATUS_BROADCAST;
-// ESP-NOW 回调事件队列
+// ESP-NOW 回调事件队列，收到的帧按字节计入MBUDGET_CB
 static xQueueHandle espnow_cb_queue = NULL;
-// 无线数据接收队列
-static xQueueHandle wlcon_recv_queue = NULL;
-static xQueueHandle wlcon_send_queue = NULL;
+MBUDGET_QUEUE_DEFINE(espnow_cb_queue, ESPNOW_CB_QUEUE_SIZE, sizeof(espnow_event_t));
+// 逻辑通道，发送时高优先级通道总是先于低优先级通道，同优先级按权重分配带宽
+typedef struct
+{
+    xQueueHandle send;
+    xQueueHandle recv;
+    uint8_t priority; // 越大越优先
+    uint8_t weight;   // 同优先级通道间的带宽比例
+    int32_t deficit;  // 差额轮询的剩余额度(字节)
+    uint16_t busy;    // 队首数据包收到忙应答的次数
+} wlcon_stream_t;
+static wlcon_stream_t streams[WLCON_STREAM_MAX] = {0};
+// 差额轮询当前服务的通道
+static uint8_t stream_cursor = 0;
+// 权重为1的通道每轮获得的额度，保证一轮内至少能发出一个最大的数据包
+#define STREAM_QUANTUM WIRELESS_PACKET_MAX_PAYLOAD_SIZE
 // 主机决定码
 uint8_t master_ruling_code = 0;
-// 心跳定时器
-static esp_timer_handle_t heartbeat_timer = NULL;
-// 心跳时间间隔
-static uint32_t heartbeat_time = 0;
-// 心跳发送间隔，防止心跳包发送过快
-static uint32_t heartbeat_interval = 0;
+// 协议定时器：所有超时都挂在时间轮上，esp_timer只在最近的到期时间单次触发
+static esp_timer_handle_t wheel_timer = NULL;
+static twheel_t wheel;
+// esp_timer当前设定的到期时间；wheel_fired表示单次定时器已触发，与到期事件是否投递成功无关
+static int64_t wheel_armed = TWHEEL_NEVER;
+static volatile bool wheel_fired = false;
+static twheel_timer_t broadcast_timer,    // 广播
+                      connect_timer,      // 连接请求重试
+                      heartbeat_tx_timer, // 主机发送心跳
+                      heartbeat_rx_timer, // 心跳超时
+                      retrans_timer;      // 数据应答超时
+// 定时器/发送事件已在队列中，不重复投递
+static volatile bool timer_evt_pending = false,
+                     tx_evt_pending = false;
+// 连接重试次数
+static int retry_count = 0;
+// 每一次发起连接的代码，标记不同的连接包
+static uint8_t connect_code = 0;
+// 等待应答的数据包，收到应答或重传次数耗尽后释放
+static wireless_packet_t *tx_frame = NULL;
+static size_t tx_frame_len = 0;
+static int tx_retry = 0;
+// 数据包序号，0留给心跳包
+static uint16_t tx_seq = 0, rx_seq = 0;
 // 任务优先级
 static int wlcon_manager_priority = CONFIG_WLCON_MANAGER_PRORITY;
 // 任务句柄
 static TaskHandle_t wlcon_manager_handle = NULL;
+// 链路统计
+static wlcon_stats_t wlcon_stats = {0};
+#if CONFIG_WLCON_CHANNEL_AUTO
+// 信道管理
+static chanmgr_t chanmgr;
+static twheel_timer_t channel_timer;
+// 主机：正在协商切换的目标信道及请求次数
+static uint8_t channel_target = 0;
+static int channel_retry = 0;
+// 从机：信道应答包发出后要切换到的信道，应答包的发送序号及重发次数
+static uint8_t channel_pending = 0;
+static uint32_t channel_ack_id = 0;
+static int channel_ack_retry = 0;
+#endif
+// 已交给传输层的帧数与收到的发送回调数，用于把发送回调对应到具体的帧
+static uint32_t tx_send_id = 0;
+static uint32_t tx_cb_id = 0;
 
 // 静态分配数据包，避免重复的IO操作
 static wireless_packet_t *broadcast_packet = NULL,
@@ -65,15 +148,17 @@ static wireless_packet_t *broadcast_packet = NULL,
                          *connect_establish_packet = NULL,
                          *heartbeat_packet = NULL,
                          *heartbeat_ack_packet = NULL,
-                         *data_ack_packet = NULL;
+                         *data_ack_packet = NULL,
+                         *channel_packet = NULL;
 
 static size_t bp_len = sizeof(wireless_packet_t) + 1,
-              crp_len = sizeof(wireless_packet_t) + 2,
-              cap_len = sizeof(wireless_packet_t) + 2,
-              cep_len = sizeof(wireless_packet_t) + 2,
+              crp_len = sizeof(wireless_packet_t) + 2 + CONNECT_EXTRA_LEN,
+              cap_len = sizeof(wireless_packet_t) + 2 + CONNECT_EXTRA_LEN,
+              cep_len = sizeof(wireless_packet_t) + 2 + CONNECT_EXTRA_LEN,
               hp_len = sizeof(wireless_packet_t),
               hap_len = sizeof(wireless_packet_t),
-              dap_len = sizeof(wireless_packet_t);
+              dap_len = sizeof(wireless_packet_t),
+              cnp_len = sizeof(wireless_packet_t) + 2;
 
 #define free_p(p)        \
     if (p != NULL)       \
@@ -91,6 +176,7 @@ void destroy_packet()
     free_p(heartbeat_packet);
     free_p(heartbeat_ack_packet);
     free_p(data_ack_packet);
+    free_p(channel_packet);
 }
 
 bool wlcon_create_packet()
@@ -102,8 +188,9 @@ bool wlcon_create_packet()
     connect_establish_packet = malloc(cep_len);
     heartbeat_packet = malloc(hp_len);
     heartbeat_ack_packet = malloc(hap_len);
-    data_ack_packet = malloc(dap_len);
-    if (broadcast_packet == NULL || connect_rst_packet == NULL || connect_ack_packet == NULL || connect_establish_packet == NULL || heartbeat_packet == NULL || heartbeat_ack_packet == NULL || data_ack_packet == NULL)
+    data_ack_packet = malloc(dap_len + 1);
+    channel_packet = malloc(cnp_len);
+    if (broadcast_packet == NULL || connect_rst_packet == NULL || connect_ack_packet == NULL || connect_establish_packet == NULL || heartbeat_packet == NULL || heartbeat_ack_packet == NULL || data_ack_packet == NULL || channel_packet == NULL)
     {
         ESP_LOGE(TAG, "Malloc packet fail");
         destroy_packet();
@@ -113,29 +200,37 @@ bool wlcon_create_packet()
     broadcast_packet->length = 1;
     broadcast_packet->version = WIRELESS_PACKET_VERSION;
     broadcast_packet->crc = 0;
+    broadcast_packet->seq = 0;
+    broadcast_packet->stream = 0;
     broadcast_packet->payload[0] = master_ruling_code;
-    broadcast_packet->crc = crc16_le(UINT16_MAX, (uint8_t const *)broadcast_packet, sizeof(wireless_packet_t) + 1);
+    broadcast_packet->crc = crc16_update(UINT16_MAX, (const uint8_t *)broadcast_packet, sizeof(wireless_packet_t) + 1);
     // 连接包
     connect_rst_packet->type = WIRELESS_PACKET_TYPE_CONNECT;
-    connect_rst_packet->length = 2;
+    connect_rst_packet->length = 2 + CONNECT_EXTRA_LEN;
     connect_rst_packet->version = WIRELESS_PACKET_VERSION;
     connect_rst_packet->crc = 0;
+    connect_rst_packet->seq = 0;
+    connect_rst_packet->stream = 0;
     connect_rst_packet->payload[0] = 1;
     connect_rst_packet->payload[1] = 0;
     connect_rst_packet->crc = 0;
 
     connect_ack_packet->type = WIRELESS_PACKET_TYPE_CONNECT;
-    connect_ack_packet->length = 2;
+    connect_ack_packet->length = 2 + CONNECT_EXTRA_LEN;
     connect_ack_packet->version = WIRELESS_PACKET_VERSION;
     connect_ack_packet->crc = 0;
+    connect_ack_packet->seq = 0;
+    connect_ack_packet->stream = 0;
     connect_ack_packet->payload[0] = 2;
     connect_ack_packet->payload[1] = 0;
     connect_ack_packet->crc = 0;
 
     connect_establish_packet->type = WIRELESS_PACKET_TYPE_CONNECT;
-    connect_establish_packet->length = 2;
+    connect_establish_packet->length = 2 + CONNECT_EXTRA_LEN;
     connect_establish_packet->version = WIRELESS_PACKET_VERSION;
     connect_establish_packet->crc = 0;
+    connect_establish_packet->seq = 0;
+    connect_establish_packet->stream = 0;
     connect_establish_packet->payload[0] = 3;
     connect_establish_packet->payload[1] = 0;
     connect_establish_packet->crc = 0;
@@ -144,32 +239,47 @@ bool wlcon_create_packet()
     heartbeat_packet->length = 0;
     heartbeat_packet->version = WIRELESS_PACKET_VERSION;
     heartbeat_packet->crc = 0;
-    heartbeat_packet->crc = crc16_le(UINT16_MAX, (uint8_t const *)heartbeat_packet, hp_len);
+    heartbeat_packet->seq = 0;
+    heartbeat_packet->stream = 0;
+    heartbeat_packet->crc = crc16_update(UINT16_MAX, (const uint8_t *)heartbeat_packet, hp_len);
 
     heartbeat_ack_packet->type = WIRELESS_PACKET_TYPE_DATA_ACK;
     heartbeat_ack_packet->length = 0;
     heartbeat_ack_packet->version = WIRELESS_PACKET_VERSION;
     heartbeat_ack_packet->crc = 0;
-    heartbeat_ack_packet->crc = crc16_le(UINT16_MAX, (uint8_t const *)heartbeat_ack_packet, hap_len);
+    heartbeat_ack_packet->seq = 0;
+    heartbeat_ack_packet->stream = 0;
+    heartbeat_ack_packet->crc = crc16_update(UINT16_MAX, (const uint8_t *)heartbeat_ack_packet, hap_len);
 
     data_ack_packet->type = WIRELESS_PACKET_TYPE_DATA_ACK;
     data_ack_packet->length = 0;
     data_ack_packet->version = WIRELESS_PACKET_VERSION;
     data_ack_packet->crc = 0;
-    data_ack_packet->crc = crc16_le(UINT16_MAX, (uint8_t const *)data_ack_packet, dap_len);
+    data_ack_packet->seq = 0;
+    data_ack_packet->stream = 0;
+    data_ack_packet->crc = crc16_update(UINT16_MAX, (const uint8_t *)data_ack_packet, dap_len);
+
+    channel_packet->type = WIRELESS_PACKET_TYPE_CHANNEL;
+    channel_packet->length = 2;
+    channel_packet->version = WIRELESS_PACKET_VERSION;
+    channel_packet->crc = 0;
+    channel_packet->seq = 0;
+    channel_packet->stream = 0;
+    channel_packet->payload[0] = CHAN_TYPE_REQ;
+    channel_packet->payload[1] = 0;
     return true;
 }
 
 /**
- * @brief ESP-NOW发送回调函数
+ * @brief 无线发送回调函数
  *
- * 当ESP-NOW数据发送完成时，系统会调用此回调函数来通知发送结果。
+ * 当传输层数据发送完成时，系统会调用此回调函数来通知发送结果。
  * 该函数会将发送结果封装成事件并发送到espnow_cb_queue队列中。
  *
- * @param mac_addr 接收设备的MAC地址指针
- * @param status 发送状态，表示数据发送成功或失败
+ * @param mac_addr 接收设备的地址指针
+ * @param success 发送是否成功
  */
-static void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+static void wlcon_send_cb(const uint8_t *mac_addr, bool success)
 {
     espnow_event_t evt;
     espnow_event_send_cb_t *send_cb = &evt.info.send_cb;
@@ -189,28 +299,58 @@ static void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status
     }
     // 封装发送回调事件信息
     evt.id = ESPNOW_SEND_CB;
-    // memcpy(send_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-    send_cb->status = status;
+    // memcpy(send_cb->mac_addr, mac_addr, WLCON_ADDR_LEN);
+    send_cb->status = success ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL;
+    // 在回调中编号，事件入队失败也不会打乱之后的序号
+    send_cb->id = ++tx_cb_id;
     // 将事件发送到队列中
     if (xQueueSend(espnow_cb_queue, &evt, pdMS_TO_TICKS(10)) != pdTRUE)
     {
-        ESP_LOGW(TAG, "Func[espnow_send_cb] Send queue fail");
+        ESP_LOGW(TAG, "Func[wlcon_send_cb] Send queue fail");
     }
 }
 
 /**
- * @brief ESP-NOW数据接收回调函数
+ * @brief 复制收到的帧，同时计算CRC
  *
- * 当ESP-NOW接收到数据时，该回调函数会被调用。函数将接收的数据封装成事件结构体，
+ * CRC按crc字段为0计算，覆盖帧头和length指定的负载，与发送端一致；
+ * 帧尾的会话加密字段只复制。长度不合法的帧只复制，由wireless_packet_check丢弃。
+ *
+ * @return 计算得到的CRC
+ */
+static uint16_t wlcon_copy_frame(uint8_t *dst, const uint8_t *src, int len)
+{
+    static const uint8_t crc_zero[sizeof(((wireless_packet_t *)0)->crc)] = {0};
+    const size_t crc_off = offsetof(wireless_packet_t, crc);
+    const size_t crc_end = crc_off + sizeof(crc_zero);
+    const wireless_packet_t *packet = (const wireless_packet_t *)src;
+    if (len < (int)sizeof(wireless_packet_t) || packet->length > len - sizeof(wireless_packet_t))
+    {
+        memcpy(dst, src, len);
+        return 0;
+    }
+    size_t covered = sizeof(wireless_packet_t) + packet->length;
+    uint16_t crc = crc16_copy(UINT16_MAX, dst, src, crc_off);
+    crc = crc16_update(crc, crc_zero, sizeof(crc_zero));
+    memcpy(dst + crc_off, src + crc_off, sizeof(crc_zero));
+    crc = crc16_copy(crc, dst + crc_end, src + crc_end, covered - crc_end);
+    memcpy(dst + covered, src + covered, len - covered);
+    return crc;
+}
+
+/**
+ * @brief 无线数据接收回调函数
+ *
+ * 当传输层接收到数据时，该回调函数会被调用。函数将接收的数据封装成事件结构体，
  * 并发送到ESP-NOW事件队列中供其他任务处理。
  *
- * @param mac_addr 源设备的MAC地址指针
+ * @param mac_addr 源设备的地址指针
  * @param data 接收到的数据指针
  * @param len 接收数据的长度
  *
  * @return 无返回值
  */
-static void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
+static void wlcon_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len)
 {
     espnow_event_t evt;
     espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
@@ -221,34 +361,184 @@ static void espnow_recv_cb(const uint8_t *mac_addr, const uint8_t *data, int len
         ESP_LOGE(TAG, "Receive cb arg error");
         return;
     }
+    if (len > (int)transport->mtu)
+    {
+        ESP_LOGW(TAG, "Drop oversized frame: %d", len);
+        return;
+    }
     if (espnow_cb_queue == NULL)
     {
         ESP_LOGE(TAG, "Send cb error: espnow_cb_queue is NULL");
         return;
     }
+    /* 回调中不能等待，额度不足时丢弃，数据帧没有应答，对端会重传 */
+    if (!mbudget_acquire(MBUDGET_CB, MBUDGET_CHARGE(len), 0))
+    {
+        mbudget_reject(MBUDGET_CB);
+        return;
+    }
     /* 为接收数据分配内存空间 */
     recv_cb->data = malloc(len);
     if (recv_cb->data == NULL)
     {
         ESP_LOGE(TAG, "Malloc receive data fail");
+        mbudget_release(MBUDGET_CB, MBUDGET_CHARGE(len));
         return;
     }
     evt.id = ESPNOW_RECV_CB;
     recv_cb->len = len;
-    memcpy(recv_cb->data, data, len);
-    memcpy(recv_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
+    recv_cb->crc = wlcon_copy_frame(recv_cb->data, data, len);
+    memcpy(recv_cb->mac_addr, mac_addr, WLCON_ADDR_LEN);
     /* 将接收事件发送到队列中 */
     if (xQueueSend(espnow_cb_queue, &evt, pdMS_TO_TICKS(10)) != pdTRUE)
     {
-        ESP_LOGW(TAG, "Func[espnow_recv_cb] Send queue fail");
+        ESP_LOGW(TAG, "Func[wlcon_recv_cb] Send queue fail");
+        free(recv_cb->data);
+        mbudget_release(MBUDGET_CB, MBUDGET_CHARGE(len));
+        mbudget_reject(MBUDGET_CB);
+    }
+}
+
+#if CONFIG_WLCON_AEAD
+/**
+ * @brief 会话加密
+ *
+ * 连接请求/应答包各携带一端的随机数，两端用预共享密钥和两个随机数派生本次连接的会话密钥，
+ * 连接建立包携带密钥确认码。连接后的DATA/DATA_ACK/CHANNEL包以帧头为关联数据、负载加密，
+ * 帧尾附加4字节帧计数(大端)和截短的标签，crc字段固定为0。帧计数每发送一帧加1，
+ * 重传也重新加密，接收端只接受更大的计数，避免重放。
+ */
+static uint8_t session_key[ASCON_KEY_LEN];
+static bool session_secure = false;
+static uint8_t nonce_local[CONNECT_EXTRA_LEN], nonce_peer[CONNECT_EXTRA_LEN];
+static uint32_t aead_tx_ctr = 0, aead_rx_ctr = 0;
+// 加密后的发送帧，只在连接管理任务中使用
+static uint8_t seal_buf[WLCON_TRANSPORT_MTU];
+
+static void aead_random(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        buf[i] = esp_random() & 0xff;
+}
+
+// 帧随机数：发送方向(主机'M'/从机'S') + 帧计数，同一会话内不会重复
+static void aead_nonce(uint8_t *nonce, bool from_master, uint32_t ctr)
+{
+    memset(nonce, 0, ASCON_NONCE_LEN);
+    nonce[0] = from_master ? 'M' : 'S';
+    nonce[12] = ctr >> 24;
+    nonce[13] = ctr >> 16;
+    nonce[14] = ctr >> 8;
+    nonce[15] = ctr;
+}
+
+// 会话密钥 = 以预共享密钥对两端随机数计算的Ascon-128标签
+// 预共享密钥必须正好16个字符，不补零也不截断
+_Static_assert(sizeof(CONFIG_WLCON_AEAD_PSK) - 1 == ASCON_KEY_LEN, "WLCON_AEAD_PSK must be 16 characters");
+
+static void aead_derive(const uint8_t *master_nonce, const uint8_t *slave_nonce)
+{
+    uint8_t psk[ASCON_KEY_LEN];
+    uint8_t nonce[ASCON_NONCE_LEN] = {'K', 'D', 'F'};
+    uint8_t ad[2 * CONNECT_EXTRA_LEN];
+    memcpy(psk, CONFIG_WLCON_AEAD_PSK, sizeof(psk));
+    memcpy(ad, master_nonce, CONNECT_EXTRA_LEN);
+    memcpy(ad + CONNECT_EXTRA_LEN, slave_nonce, CONNECT_EXTRA_LEN);
+    ascon128_encrypt(psk, nonce, ad, sizeof(ad), NULL, NULL, 0, session_key);
+    aead_tx_ctr = 0;
+    aead_rx_ctr = 0;
+}
+
+// 密钥确认码：会话密钥下帧计数0对连接码的标签，帧计数0不用于数据帧
+static void aead_confirm_code(uint8_t connect_code, uint8_t *code)
+{
+    uint8_t nonce[ASCON_NONCE_LEN], tag[ASCON_TAG_LEN];
+    aead_nonce(nonce, true, 0);
+    ascon128_encrypt(session_key, nonce, &connect_code, 1, NULL, NULL, 0, tag);
+    memcpy(code, tag, CONNECT_EXTRA_LEN);
+}
+
+static const uint8_t *aead_seal(const wireless_packet_t *packet, size_t *len)
+{
+    uint8_t nonce[ASCON_NONCE_LEN], tag[ASCON_TAG_LEN];
+    wireless_packet_t *sealed = (wireless_packet_t *)seal_buf;
+    uint8_t *trailer = sealed->payload + packet->length;
+    uint32_t ctr = ++aead_tx_ctr;
+    memcpy(sealed, packet, sizeof(wireless_packet_t));
+    sealed->crc = 0;
+    trailer[0] = ctr >> 24;
+    trailer[1] = ctr >> 16;
+    trailer[2] = ctr >> 8;
+    trailer[3] = ctr;
+    aead_nonce(nonce, is_master, ctr);
+    ascon128_encrypt(session_key, nonce, seal_buf, sizeof(wireless_packet_t),
+                     packet->payload, sealed->payload, packet->length, tag);
+    memcpy(trailer + 4, tag, WLCON_AEAD_TAG_LEN);
+    *len = sizeof(wireless_packet_t) + packet->length + WLCON_AEAD_OVERHEAD;
+    return seal_buf;
+}
+
+// 校验并原地解密，len为收到的帧长度
+static bool aead_open(wireless_packet_t *packet, int len)
+{
+    uint8_t nonce[ASCON_NONCE_LEN];
+    if (len < (int)(sizeof(wireless_packet_t) + WLCON_AEAD_OVERHEAD) ||
+        packet->length != len - sizeof(wireless_packet_t) - WLCON_AEAD_OVERHEAD)
+    {
+        return false;
+    }
+    const uint8_t *trailer = packet->payload + packet->length;
+    uint32_t ctr = (uint32_t)trailer[0] << 24 | (uint32_t)trailer[1] << 16 | (uint32_t)trailer[2] << 8 | trailer[3];
+    if (ctr <= aead_rx_ctr)
+    {
+        return false;
+    }
+    aead_nonce(nonce, !is_master, ctr);
+    if (!ascon128_decrypt(session_key, nonce, (const uint8_t *)packet, sizeof(wireless_packet_t),
+                          packet->payload, packet->payload, packet->length, trailer + 4, WLCON_AEAD_TAG_LEN))
+    {
+        return false;
+    }
+    aead_rx_ctr = ctr;
+    return true;
+}
+#endif
+
+// 连接后受会话加密保护的数据包类型，不再计算CRC
+static inline bool packet_sealed(wireless_packet_type_t type)
+{
+#if CONFIG_WLCON_AEAD
+    return session_secure && (type == WIRELESS_PACKET_TYPE_DATA || type == WIRELESS_PACKET_TYPE_DATA_ACK ||
+                              type == WIRELESS_PACKET_TYPE_CHANNEL);
+#else
+    return false;
+#endif
+}
+
+// 所有数据包都经此发送，需要时先加密。发送成功后tx_send_id为本帧的发送序号
+static esp_err_t wlcon_packet_send(const uint8_t *addr, const wireless_packet_t *packet, size_t len)
+{
+    const uint8_t *data = (const uint8_t *)packet;
+#if CONFIG_WLCON_AEAD
+    if (packet_sealed(packet->type))
+    {
+        if (sizeof(wireless_packet_t) + packet->length + WLCON_AEAD_OVERHEAD > transport->mtu)
+            return ESP_ERR_INVALID_SIZE;
+        data = aead_seal(packet, &len);
     }
-    // free(recv_cb->data);
+#endif
+    if (len > transport->mtu)
+        return ESP_ERR_INVALID_SIZE;
+    esp_err_t ret = transport->send(addr, data, len);
+    if (ret == ESP_OK)
+        tx_send_id++;
+    return ret;
 }
 
 // 封装数据包发送函数
 static inline bool send_broadcast_packet()
 {
-    if (esp_now_send(broadcast_mac, (uint8_t *)broadcast_packet, bp_len) != ESP_OK)
+    if (wlcon_packet_send(broadcast_mac, broadcast_packet, bp_len) != ESP_OK)
     {
         ESP_LOGE(TAG, "Send broadcast packet fail");
         return false;
@@ -277,9 +567,19 @@ static inline bool send_connect_packet(int type, uint8_t connect_code)
         sp_len = cep_len;
     }
     s_packet->payload[1] = connect_code;
+#if CONFIG_WLCON_AEAD
+    if (type == CON_TYPE_EST)
+    {
+        aead_confirm_code(connect_code, s_packet->payload + 2);
+    }
+    else
+    {
+        memcpy(s_packet->payload + 2, nonce_local, CONNECT_EXTRA_LEN);
+    }
+#endif
     s_packet->crc = 0;
-    s_packet->crc = crc16_le(UINT16_MAX, (uint8_t *)s_packet, sp_len);
-    if (esp_now_send(target_mac, (uint8_t *)s_packet, sp_len) != ESP_OK)
+    s_packet->crc = crc16_update(UINT16_MAX, (const uint8_t *)s_packet, sp_len);
+    if (wlcon_packet_send(target_mac, s_packet, sp_len) != ESP_OK)
     {
         ESP_LOGE(TAG, "Send connecting packet fail");
         return false;
@@ -289,7 +589,7 @@ static inline bool send_connect_packet(int type, uint8_t connect_code)
 
 static inline bool send_heartbeat_packet(int type)
 {
-    if (esp_now_send(target_mac, (uint8_t *)(type == 1 ? heartbeat_packet : heartbeat_ack_packet), hp_len) != ESP_OK)
+    if (wlcon_packet_send(target_mac, type == 1 ? heartbeat_packet : heartbeat_ack_packet, hp_len) != ESP_OK)
     {
         ESP_LOGE(TAG, "Send heartbeat packet fail");
         return false;
@@ -297,9 +597,17 @@ static inline bool send_heartbeat_packet(int type)
     return true;
 }
 
-static inline bool send_ack_packet()
+// busy为true时应答负载为DATA_ACK_BUSY，表示收到但接收额度不足，对端稍后重传且不计入重传次数
+static inline bool send_ack_packet(uint16_t seq, bool busy)
 {
-    if (esp_now_send(target_mac, (uint8_t *)data_ack_packet, dap_len) != ESP_OK)
+    size_t len = dap_len + (busy ? 1 : 0);
+    data_ack_packet->seq = seq;
+    data_ack_packet->length = busy ? 1 : 0;
+    data_ack_packet->payload[0] = DATA_ACK_BUSY;
+    data_ack_packet->crc = 0;
+    if (!packet_sealed(WIRELESS_PACKET_TYPE_DATA_ACK))
+        data_ack_packet->crc = crc16_update(UINT16_MAX, (const uint8_t *)data_ack_packet, len);
+    if (wlcon_packet_send(target_mac, data_ack_packet, len) != ESP_OK)
     {
         ESP_LOGE(TAG, "Send ack packet fail");
         return false;
@@ -307,46 +615,96 @@ static inline bool send_ack_packet()
     return true;
 }
 
-// 优化后的CRC校验宏
-#define CRC_CHECK(packet) ({                                                                                 \
-    uint16_t crc_recv = packet->crc;                                                                         \
-    packet->crc = 0;                                                                                         \
-    uint16_t crc_calc = crc16_le(UINT16_MAX, (uint8_t *)packet, sizeof(wireless_packet_t) + packet->length); \
-    packet->crc = crc_recv;                                                                                  \
-    crc_calc == crc_recv;                                                                                    \
-})
+static inline bool send_channel_packet(int type, uint8_t channel)
+{
+    channel_packet->payload[0] = type;
+    channel_packet->payload[1] = channel;
+    channel_packet->crc = 0;
+    if (!packet_sealed(WIRELESS_PACKET_TYPE_CHANNEL))
+        channel_packet->crc = crc16_update(UINT16_MAX, (const uint8_t *)channel_packet, cnp_len);
+    if (wlcon_packet_send(target_mac, channel_packet, cnp_len) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Send channel packet fail");
+        return false;
+    }
+    return true;
+}
 
-void wireless_add_peer(const uint8_t *mac_addr, bool encrypt)
+#if CONFIG_WLCON_CHANNEL_AUTO
+static void wlcon_set_channel(uint8_t channel)
 {
+    if (!chanmgr_valid(channel) || transport->set_channel(channel) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Set channel %d fail", channel);
+        return;
+    }
+    chanmgr_switched(&chanmgr, channel);
+    // 给对端留出切换时间
+    twheel_add(&wheel, &heartbeat_rx_timer, esp_timer_get_time() + HEARTBEAT_TIMEOUT_US);
+    printf("Channel %d.\n", channel);
+}
 
-    if (esp_now_is_peer_exist(mac_addr) == false)
+/**
+ * @brief 启动时扫描各信道上的AP，作为选择信道的依据
+ *
+ * 扫描结束后回到CONFIG_ESPNOW_CHANNEL，两端始终在此信道上发现对方，连接后再由主机协调切换。
+ */
+static void wlcon_channel_scan(void)
+{
+    chanmgr_init(&chanmgr, CONFIG_ESPNOW_CHANNEL, CONFIG_WLCON_CHANNEL_LOSS_THRESHOLD);
+    uint16_t ap_num = 0;
+    if (esp_wifi_scan_start(NULL, true) != ESP_OK || esp_wifi_scan_get_ap_num(&ap_num) != ESP_OK)
     {
-        esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
-        if (peer == NULL)
+        ESP_LOGE(TAG, "Channel scan fail");
+        return;
+    }
+    if (ap_num > CHANNEL_SCAN_MAX_AP)
+        ap_num = CHANNEL_SCAN_MAX_AP;
+    wifi_ap_record_t *records = ap_num > 0 ? malloc(ap_num * sizeof(wifi_ap_record_t)) : NULL;
+    if (records != NULL && esp_wifi_scan_get_ap_records(&ap_num, records) == ESP_OK)
+    {
+        for (int i = 0; i < ap_num; i++)
         {
-            ESP_LOGE(TAG, "Malloc peer information fail");
-            vTaskDelete(NULL);
+            chanmgr_add_scan(&chanmgr, records[i].primary, records[i].rssi);
         }
-        memset(peer, 0, sizeof(esp_now_peer_info_t));
-        peer->channel = CONFIG_ESPNOW_CHANNEL;
-        peer->ifidx = ESPNOW_WIFI_IF;
-        peer->encrypt = encrypt;
-        if (encrypt)
-            memcpy(peer->lmk, CONFIG_ESPNOW_LMK, ESP_NOW_KEY_LEN);
-        memcpy(peer->peer_addr, mac_addr, ESP_NOW_ETH_ALEN);
-        ESP_ERROR_CHECK(esp_now_add_peer(peer));
-        free(peer);
-        // 记录对方MAC地址
-        memcpy(target_mac, mac_addr, ESP_NOW_ETH_ALEN);
     }
+    free(records);
+    ESP_LOGI(TAG, "Scanned %d APs, quietest channel %d", ap_num, chanmgr_best(&chanmgr));
+    ESP_ERROR_CHECK(transport->set_channel(CONFIG_ESPNOW_CHANNEL));
 }
+#endif
 
-static inline bool wireless_packet_check(wireless_packet_t *packet)
+void wireless_add_peer(const uint8_t *mac_addr, bool encrypt)
+{
+
+    if (transport->is_peer_exist(mac_addr) == false)
+    {
+        ESP_ERROR_CHECK(transport->add_peer(mac_addr, encrypt));
+    }
+    // 记录对方地址
+    memcpy(target_mac, mac_addr, WLCON_ADDR_LEN);
+}
+
+// 各类型数据包负载的最小长度，处理时按此长度读取负载
+static const uint8_t packet_min_length[] = {
+    [WIRELESS_PACKET_TYPE_BROADCAST] = 1,
+    [WIRELESS_PACKET_TYPE_CONNECT] = 2 + CONNECT_EXTRA_LEN,
+    [WIRELESS_PACKET_TYPE_DATA] = 0,
+    [WIRELESS_PACKET_TYPE_DATA_ACK] = 0,
+    [WIRELESS_PACKET_TYPE_CHANNEL] = 2,
+};
+
+/**
+ * @brief 检查收到的数据包
+ *
+ * @param crc 复制数据包时计算的CRC，见wlcon_copy_frame
+ */
+static inline bool wireless_packet_check(wireless_packet_t *packet, int len, uint16_t crc)
 {
     // 检查数据包长度
-    if (packet == NULL) // ||packet->length > WIRELESS_PACKET_MAX_PAYLOAD_SIZE)
+    if (packet == NULL || len < (int)sizeof(wireless_packet_t) || packet->length > len - sizeof(wireless_packet_t))
     {
-        ESP_LOGE(TAG, "Invalid packet length: %d", packet->length);
+        ESP_LOGE(TAG, "Invalid packet length: %d", len);
         return false;
     }
     // 检查版本号
@@ -355,8 +713,26 @@ static inline bool wireless_packet_check(wireless_packet_t *packet)
         ESP_LOGE(TAG, "Unsupported packet version: %d", packet->version);
         return false;
     }
+    // 检查类型与负载长度
+    if ((unsigned)packet->type >= sizeof(packet_min_length) || packet->length < packet_min_length[packet->type])
+    {
+        ESP_LOGE(TAG, "Invalid packet type %d length %d", packet->type, packet->length);
+        return false;
+    }
+#if CONFIG_WLCON_AEAD
+    // 会话加密的数据包校验标签并解密
+    if (packet_sealed(packet->type))
+    {
+        if (!aead_open(packet, len))
+        {
+            ESP_LOGE(TAG, "AEAD check failed");
+            return false;
+        }
+        return true;
+    }
+#endif
     // CRC校验
-    if (!CRC_CHECK(packet))
+    if (crc != packet->crc)
     {
         ESP_LOGE(TAG, "CRC check failed");
         return false;
@@ -364,251 +740,839 @@ static inline bool wireless_packet_check(wireless_packet_t *packet)
     return true;
 }
 
-void wlcon_con_manager(void *pvParameters)
+/**
+ * @brief 向连接管理任务投递定时器或发送事件
+ *
+ * 同类事件还未被处理时不重复投递。队列已满时管理任务正忙，处理完队列中的事件后
+ * 总会检查定时器与发送队列，丢弃本次通知不会遗漏。
+ */
+static void wlcon_post_event(espnow_event_id_t id, volatile bool *pending)
+{
+    if (*pending || espnow_cb_queue == NULL)
+    {
+        return;
+    }
+    *pending = true;
+    espnow_event_t evt = {
+        .id = id,
+    };
+    if (xQueueSend(espnow_cb_queue, &evt, 0) != pdTRUE)
+    {
+        *pending = false;
+    }
+}
+
+// esp_timer到期回调，在esp_timer任务中执行，只通知管理任务
+static void wlcon_wheel_handler(void *arg)
+{
+    wheel_fired = true;
+    wlcon_post_event(ESPNOW_TIMER_EVT, &timer_evt_pending);
+}
+
+// 按时间轮中最近的到期时间重新设定esp_timer，没有定时器时不唤醒
+static void wlcon_wheel_arm(void)
+{
+    int64_t next = twheel_next(&wheel);
+    // 已触发的定时器需要重新设定，到期事件因队列满被丢弃时也不会停止
+    if (wheel_fired)
+    {
+        wheel_fired = false;
+        wheel_armed = TWHEEL_NEVER;
+    }
+    if (next == wheel_armed)
+    {
+        return;
+    }
+    esp_timer_stop(wheel_timer);
+    wheel_armed = next;
+    if (next == TWHEEL_NEVER)
+    {
+        return;
+    }
+    int64_t delay = next - esp_timer_get_time();
+    if (delay < TWHEEL_TICK_US)
+    {
+        delay = TWHEEL_TICK_US;
+    }
+    esp_timer_start_once(wheel_timer, delay);
+}
+
+// 释放等待应答的数据包
+static void wlcon_drop_tx_frame(void)
+{
+    twheel_del(&wheel, &retrans_timer);
+    free_p(tx_frame);
+}
+
+// 发送(或重传)等待应答的数据包，发送失败同样等待超时后重传
+static void wlcon_transmit_frame(void)
+{
+    if (wlcon_packet_send(target_mac, tx_frame, tx_frame_len) != ESP_OK)
+    {
+        ESP_LOGE(__FUNCTION__, "Send data packet fail");
+        wlcon_stats.tx_fail++;
+    }
+    twheel_add(&wheel, &retrans_timer, esp_timer_get_time() + CONFIG_WLCON_ACK_TIMEOUT_MS * 1000LL);
+}
+
+static inline bool stream_ready(const wlcon_stream_t *s)
+{
+    return s->send != NULL && uxQueueMessagesWaiting(s->send) > 0;
+}
+
+/**
+ * @brief 选出下一个要发送的数据包
+ *
+ * 只在有数据的最高优先级通道中选择，同优先级的通道按字节做差额轮询(DRR)：
+ * 轮到一个通道时增加weight倍的额度，额度足够发送队首数据包时发送并扣除，
+ * 否则轮到下一个通道。队列为空的通道清空额度，不能积攒带宽。
+ *
+ * @return 数据包所属通道，-1表示所有通道都没有数据
+ */
+static int wlcon_stream_pick(buf_len_t *buflen)
 {
-    // 连接重试次数
-    int retry_count = 0;
-    uint32_t last_broadcast_time = 0;
-    uint32_t last_connect_rst_time = 0;
-    // 每一次发起连接的代码，标记不同的连接包
-    uint8_t connect_code = 0;
-    // 接受回调事件
-    espnow_event_t evt = {0};
-    // 接受外部输入数据
-    buf_len_t buflen = {0};
-    // 等待上一个数据包的应答包
-    bool wait_ack = false;
-    esp_timer_start_periodic(heartbeat_timer, 1000 * 10); // 设置心跳间隔为配置的心跳间隔
     while (1)
     {
-        if (status == WIRELESS_STATUS_CONNECTED)
+        int prio = -1;
+        for (int i = 0; i < WLCON_STREAM_MAX; i++)
         {
-            if (heartbeat_time > (CONFIG_HEARTBEAT_INTERVAL + 1000))
+            if (stream_ready(&streams[i]) && streams[i].priority > prio)
             {
-                // 心跳超时, 连接断开
-                status = WIRELESS_STATUS_DISCONNECTED;
+                prio = streams[i].priority;
             }
-
-            // 处理数据发送
-            if (!wait_ack && wlcon_send_queue != NULL && xQueueReceive(wlcon_send_queue, &buflen, pdMS_TO_TICKS(1)) == pdTRUE)
+        }
+        if (prio < 0)
+        {
+            return -1;
+        }
+        // 数据包不超过STREAM_QUANTUM，weight至少为1，有数据的通道两轮内一定能发送。
+        // 其他任务可能在扫描期间取走队列中的数据(DROP_OLDEST)，扫描两轮仍未选出时重新确定优先级
+        for (int n = 0; n < 2 * WLCON_STREAM_MAX; n++)
+        {
+            wlcon_stream_t *s = &streams[stream_cursor];
+            buf_len_t head;
+            if (stream_ready(s) && s->priority == prio && xQueuePeek(s->send, &head, 0) == pdTRUE)
             {
-                wait_ack = true;
-                size_t plen = sizeof(wireless_packet_t) + buflen.len;
-                wireless_packet_t *wp = malloc(plen);
-                if (wp == NULL)
-                {
-                    ESP_LOGE(TAG, "内存分配失败!");
-                    continue;
-                }
-                wp->version = WIRELESS_PACKET_VERSION;
-                wp->type = WIRELESS_PACKET_TYPE_DATA;
-                wp->length = buflen.len;
-                wp->crc = 0;
-                memcpy(wp->payload, buflen.buf, buflen.len);
-                wp->crc = crc16_le(UINT16_MAX, (uint8_t const *)wp, plen);
-                if (esp_now_send(target_mac, (uint8_t *)wp, plen) != ESP_OK)
-                {
-                    ESP_LOGE(__FUNCTION__, "Send data packet fail");
-                    wait_ack = false;
-                }
-                free(wp);
-                if ((buflen.flag & 0x01) == 0x01)
+                if (s->deficit >= head.len)
                 {
-                    free(buflen.buf);
+                    xQueueReceive(s->send, buflen, 0);
+                    mbudget_release(MBUDGET_TX, MBUDGET_CHARGE(buflen->len));
+                    s->deficit -= head.len;
+                    if (!stream_ready(s))
+                    {
+                        s->deficit = 0;
+                    }
+                    return stream_cursor;
                 }
             }
+            else if (!stream_ready(s))
+            {
+                s->deficit = 0;
+            }
+            stream_cursor = (stream_cursor + 1) % WLCON_STREAM_MAX;
+            if (stream_ready(&streams[stream_cursor]) && streams[stream_cursor].priority == prio)
+            {
+                streams[stream_cursor].deficit += streams[stream_cursor].weight * STREAM_QUANTUM;
+            }
         }
-        else if (status == WIRELESS_STATUS_DISCONNECTED)
+    }
+}
+
+/**
+ * @brief 对端忙时把等待应答的数据包放回所属通道的队首，让其他通道先发送
+ *
+ * 对端的接收额度由所有通道共享，慢速通道的数据包一直重传会占住唯一的发送位置。
+ * 只在有同等或更高优先级的其他通道待发送时放回，额度或队列不足时继续占用发送位置。
+ *
+ * @return true 已放回，发送位置空闲
+ */
+static bool wlcon_yield_tx_frame(void)
+{
+    uint8_t id = tx_frame->stream;
+    wlcon_stream_t *s = &streams[id];
+    bool contended = false;
+    for (int i = 0; i < WLCON_STREAM_MAX; i++)
+    {
+        if (i != id && stream_ready(&streams[i]) && streams[i].priority >= s->priority)
         {
-            // 清理数据，再次广播
-            printf("Disconnected.\n");
-            // 删除对端设备
-            if (!IS_BROADCAST_ADDR(target_mac))
+            contended = true;
+        }
+    }
+    if (!contended || s->send == NULL)
+    {
+        return false;
+    }
+    buf_len_t data = {
+        .len = tx_frame->length,
+        .buf = malloc(tx_frame->length),
+        .flag = 0x01,
+    };
+    if (data.buf == NULL)
+    {
+        return false;
+    }
+    uint32_t charge = MBUDGET_CHARGE(data.len);
+    if (!mbudget_acquire(MBUDGET_TX, charge, 0))
+    {
+        free(data.buf);
+        return false;
+    }
+    memcpy(data.buf, tx_frame->payload, data.len);
+    if (xQueueSendToFront(s->send, &data, 0) != pdTRUE)
+    {
+        mbudget_release(MBUDGET_TX, charge);
+        free(data.buf);
+        return false;
+    }
+    // 未送达的数据包退还差额，从下一个通道继续轮询
+    s->deficit += data.len;
+    stream_cursor = (id + 1) % WLCON_STREAM_MAX;
+    wlcon_drop_tx_frame();
+    return true;
+}
+
+// 按通道调度取出下一个数据包，等待应答期间不发送
+static void wlcon_send_next(void)
+{
+    buf_len_t buflen = {0};
+    if (status != WIRELESS_STATUS_CONNECTED || tx_frame != NULL)
+    {
+        return;
+    }
+    int stream = wlcon_stream_pick(&buflen);
+    if (stream < 0)
+    {
+        return;
+    }
+    tx_frame_len = sizeof(wireless_packet_t) + buflen.len;
+    tx_frame = malloc(tx_frame_len);
+    if (tx_frame == NULL)
+    {
+        ESP_LOGE(TAG, "内存分配失败!");
+    }
+    else
+    {
+        if (++tx_seq == 0)
+        {
+            tx_seq = 1;
+        }
+        tx_frame->version = WIRELESS_PACKET_VERSION;
+        tx_frame->type = WIRELESS_PACKET_TYPE_DATA;
+        tx_frame->length = buflen.len;
+        tx_frame->crc = 0;
+        tx_frame->seq = tx_seq;
+        tx_frame->stream = stream;
+        if (packet_sealed(WIRELESS_PACKET_TYPE_DATA))
+        {
+            memcpy(tx_frame->payload, buflen.buf, buflen.len);
+        }
+        else
+        {
+            // 复制负载的同时计算CRC
+            uint16_t crc = crc16_update(UINT16_MAX, (const uint8_t *)tx_frame, sizeof(wireless_packet_t));
+            tx_frame->crc = crc16_copy(crc, tx_frame->payload, buflen.buf, buflen.len);
+        }
+        tx_retry = 0;
+        wlcon_stats.tx_frames++;
+        wlcon_stats.tx_bytes += buflen.len;
+        wlcon_transmit_frame();
+    }
+    if ((buflen.flag & 0x01) == 0x01)
+    {
+        free(buflen.buf);
+    }
+}
+
+// 收到对端的数据包，推迟心跳超时；主机在链路空闲一个心跳间隔后才发送心跳
+static void wlcon_link_alive(void)
+{
+    int64_t now = esp_timer_get_time();
+    twheel_add(&wheel, &heartbeat_rx_timer, now + HEARTBEAT_TIMEOUT_US);
+    if (is_master)
+    {
+        twheel_add(&wheel, &heartbeat_tx_timer, now + CONFIG_HEARTBEAT_INTERVAL * 1000LL);
+    }
+}
+
+// 停止所有随连接状态变化的定时器
+static void wlcon_stop_timers(void)
+{
+    twheel_del(&wheel, &broadcast_timer);
+    twheel_del(&wheel, &connect_timer);
+    twheel_del(&wheel, &heartbeat_tx_timer);
+    twheel_del(&wheel, &heartbeat_rx_timer);
+    twheel_del(&wheel, &retrans_timer);
+#if CONFIG_WLCON_CHANNEL_AUTO
+    twheel_del(&wheel, &channel_timer);
+#endif
+}
+
+// 进入广播状态，立即发出一个广播包
+static void wlcon_enter_broadcast(void)
+{
+    wlcon_stop_timers();
+    retry_count = 0;
+    is_master = false;
+#if CONFIG_WLCON_AEAD
+    session_secure = false;
+#endif
+    status = WIRELESS_STATUS_BROADCAST;
+    twheel_add(&wheel, &broadcast_timer, esp_timer_get_time());
+}
+
+// 主机停止广播，立即发起连接
+static void wlcon_enter_connect(void)
+{
+    wlcon_stop_timers();
+    retry_count = 0;
+    status = WIRELESS_STATUS_CONNECT_RST;
+    twheel_add(&wheel, &connect_timer, esp_timer_get_time());
+}
+
+static void wlcon_enter_connected(const uint8_t *mac_addr, bool master)
+{
+    wlcon_stop_timers();
+    is_master = master;
+    tx_seq = 0;
+    rx_seq = 0;
+    printf("Connected.\n");
+#if CONFIG_WLCON_CHANNEL_AUTO
+    if (master)
+    {
+        chanmgr_connected(&chanmgr);
+    }
+#endif
+#if CONFIG_WLCON_AEAD
+    // 会话加密在本层完成，ESP-NOW层保持不加密的peer，不受加密peer数量限制
+    wireless_add_peer(mac_addr, false);
+    session_secure = true;
+#else
+    // 重新建立加密连接
+    transport->del_peer(target_mac);
+    wireless_add_peer(mac_addr, true);
+#endif
+    status = WIRELESS_STATUS_CONNECTED;
+    wlcon_link_alive();
+}
+
+#if CONFIG_WLCON_SPOOL
+// 放回断线缓存的最前面，缓存已满时退回到末尾
+static void wlcon_spool_front(const uint8_t *data, size_t len)
+{
+    if (!spool_put_front(data, len) && !spool_put(data, len))
+    {
+        ESP_LOGW(TAG, "Spool unsent frame fail, %d bytes lost", (int)len);
+    }
+}
+
+/**
+ * @brief 断线时把尚未送达的串口数据放回断线缓存
+ *
+ * 等待应答的数据帧和数据通道发送队列中的数据按原顺序放在缓存最前面，重连后首先补发，
+ * 不会被发送队列中较晚的数据超过。
+ */
+static void wlcon_spool_unsent(void)
+{
+    buf_len_t pending[SPOOL_FRONT_MAX - 1];
+    int count = 0;
+    xQueueHandle queue = streams[WLCON_STREAM_DATA].send;
+    while (queue != NULL && count < SPOOL_FRONT_MAX - 1 && xQueueReceive(queue, &pending[count], 0) == pdTRUE)
+    {
+        mbudget_release(MBUDGET_TX, MBUDGET_CHARGE(pending[count].len));
+        count++;
+    }
+    // 后放回的先取出，从最新的开始放回
+    while (count > 0)
+    {
+        buf_len_t *data = &pending[--count];
+        wlcon_spool_front(data->buf, data->len);
+        if ((data->flag & 0x01) == 0x01)
+            free(data->buf);
+    }
+    if (tx_frame != NULL && tx_frame->stream == WLCON_STREAM_DATA)
+    {
+        wlcon_spool_front(tx_frame->payload, tx_frame->length);
+    }
+}
+#endif
+
+// 清理连接数据，再次广播
+static void wlcon_disconnect(void)
+{
+    status = WIRELESS_STATUS_DISCONNECTED;
+    printf("Disconnected.\n");
+    // 删除对端设备
+    if (!IS_BROADCAST_ADDR(target_mac))
+    {
+        transport->del_peer(target_mac);
+        memcpy(target_mac, broadcast_mac, WLCON_ADDR_LEN);
+    }
+#if CONFIG_WLCON_SPOOL
+    wlcon_spool_unsent();
+#endif
+    wlcon_drop_tx_frame();
+    for (int i = 0; i < WLCON_STREAM_MAX; i++)
+    {
+        streams[i].busy = 0;
+    }
+#if CONFIG_WLCON_CHANNEL_AUTO
+    // 回到发现信道重新广播
+    channel_target = 0;
+    channel_pending = 0;
+    twheel_del(&wheel, &channel_timer);
+    if (chanmgr.current != chanmgr.home)
+    {
+        wlcon_set_channel(chanmgr.home);
+    }
+#endif
+    wlcon_enter_broadcast();
+}
+
+static void broadcast_timeout(void *arg)
+{
+    send_broadcast_packet();
+    twheel_add(&wheel, &broadcast_timer, esp_timer_get_time() + CONFIG_BROADCAST_INTERVAL * 1000LL);
+}
+
+static void connect_timeout(void *arg)
+{
+    if (retry_count >= CONFIG_CONNECT_RETRY)
+    {
+        // 连接失败, 继续广播
+        wlcon_enter_broadcast();
+        return;
+    }
+    connect_code = esp_random() & 0xff;
+#if CONFIG_WLCON_AEAD
+    aead_random(nonce_local, CONNECT_EXTRA_LEN);
+#endif
+    send_connect_packet(CON_TYPE_RST, connect_code);
+    retry_count++;
+    twheel_add(&wheel, &connect_timer, esp_timer_get_time() + CONFIG_CONNECT_INTERVAL * 1000LL);
+}
+
+static void heartbeat_tx_timeout(void *arg)
+{
+    send_heartbeat_packet(1);
+    twheel_add(&wheel, &heartbeat_tx_timer, esp_timer_get_time() + CONFIG_HEARTBEAT_INTERVAL * 1000LL);
+}
+
+static void heartbeat_rx_timeout(void *arg)
+{
+    // 心跳超时, 连接断开
+    wlcon_disconnect();
+}
+
+static void retrans_timeout(void *arg)
+{
+    if (tx_frame == NULL)
+    {
+        return;
+    }
+    if (tx_retry >= CONFIG_WLCON_RETRANSMIT_MAX)
+    {
+        ESP_LOGW(TAG, "Drop data packet %d after %d retransmissions", tx_seq, tx_retry);
+        wlcon_stats.tx_drop++;
+        streams[tx_frame->stream].busy = 0;
+        wlcon_drop_tx_frame();
+        return;
+    }
+    tx_retry++;
+    wlcon_stats.tx_retrans++;
+    wlcon_transmit_frame();
+}
+
+#if CONFIG_WLCON_CHANNEL_AUTO
+// 从机发送信道应答，记录发送序号，只在该帧的发送回调中切换
+static void channel_ack_send(void)
+{
+    channel_ack_id = send_channel_packet(CHAN_TYPE_ACK, channel_pending) ? tx_send_id : 0;
+    twheel_add(&wheel, &channel_timer, esp_timer_get_time() + CONFIG_CONNECT_INTERVAL * 1000LL);
+}
+
+/**
+ * @brief 信道协商超时
+ *
+ * 主机：发送切换请求，对端多次无应答则放弃本次切换。
+ * 从机：应答发送失败或没有收到发送回调时重发应答，多次失败则留在当前信道，
+ * 主机若已切换，心跳超时后两端都回到发现信道重新连接。
+ */
+static void channel_timeout(void *arg)
+{
+    if (!is_master)
+    {
+        if (channel_pending == 0)
+            return;
+        if (channel_ack_retry >= CONFIG_CONNECT_RETRY)
+        {
+            ESP_LOGW(TAG, "Channel %d ack not sent, stay on %d", channel_pending, chanmgr.current);
+            channel_pending = 0;
+            return;
+        }
+        channel_ack_retry++;
+        channel_ack_send();
+        return;
+    }
+    if (channel_retry >= CONFIG_CONNECT_RETRY)
+    {
+        channel_target = 0;
+        return;
+    }
+    send_channel_packet(CHAN_TYPE_REQ, channel_target);
+    channel_retry++;
+    twheel_add(&wheel, &channel_timer, esp_timer_get_time() + CONFIG_CONNECT_INTERVAL * 1000LL);
+}
+
+// 由主机在没有待应答数据时发起信道切换
+static void wlcon_channel_poll(void)
+{
+    if (status != WIRELESS_STATUS_CONNECTED || !is_master || tx_frame != NULL || channel_target != 0)
+    {
+        return;
+    }
+    channel_target = chanmgr_check(&chanmgr);
+    if (channel_target != 0)
+    {
+        channel_retry = 0;
+        twheel_add(&wheel, &channel_timer, esp_timer_get_time());
+    }
+}
+#endif
+
+/**
+ * @brief 按阶段的溢出策略为放入queue的缓冲区申请额度
+ *
+ * DROP_OLDEST从queue中丢弃最早的缓冲区直到额度足够；BLOCK最多等待ticks_to_wait；
+ * BACKPRESSURE立即拒绝，由调用者让上游暂停。
+ *
+ * @param bytes 计入的字节数，见MBUDGET_CHARGE
+ */
+static bool wlcon_admit(mbudget_stage_t stage, xQueueHandle queue, uint32_t bytes, TickType_t ticks_to_wait)
+{
+    switch (mbudget_policy(stage))
+    {
+    case MBUDGET_DROP_OLDEST:
+        while (!mbudget_acquire(stage, bytes, 0))
+        {
+            buf_len_t oldest;
+            // 额度被其他队列占用时无法腾出
+            if (xQueueReceive(queue, &oldest, 0) != pdTRUE)
+            {
+                mbudget_reject(stage);
+                return false;
+            }
+            mbudget_drop(stage, MBUDGET_CHARGE(oldest.len));
+            if ((oldest.flag & 0x01) == 0x01)
             {
-                esp_now_del_peer(target_mac);
-                memcpy(target_mac, broadcast_mac, ESP_NOW_ETH_ALEN);
+                free(oldest.buf);
             }
-            retry_count = 0;
-            is_master = false;
-            status = WIRELESS_STATUS_BROADCAST;
         }
-        else if (status == WIRELESS_STATUS_BROADCAST)
+        return true;
+    case MBUDGET_BLOCK:
+        if (mbudget_acquire(stage, bytes, ticks_to_wait))
+        {
+            return true;
+        }
+        break;
+    case MBUDGET_BACKPRESSURE:
+        if (mbudget_acquire(stage, bytes, 0))
         {
-            // 继续广播
-            if (xTaskGetTickCount() - last_broadcast_time > pdMS_TO_TICKS(CONFIG_BROADCAST_INTERVAL))
+            return true;
+        }
+        break;
+    }
+    mbudget_reject(stage);
+    return false;
+}
+
+static void wlcon_send_cb_handler(const espnow_event_send_cb_t *send_cb)
+{
+    if (send_cb->status != ESP_NOW_SEND_SUCCESS)
+    {
+        wlcon_stats.tx_cb_fail++;
+    }
+#if CONFIG_WLCON_CHANNEL_AUTO
+    if (status == WIRELESS_STATUS_CONNECTED)
+    {
+        chanmgr_record(&chanmgr, send_cb->status != ESP_NOW_SEND_SUCCESS);
+        // 只有信道应答包自己的发送回调才切换，失败时立即重发
+        if (channel_pending != 0 && channel_ack_id != 0 && send_cb->id == channel_ack_id)
+        {
+            channel_ack_id = 0;
+            if (send_cb->status == ESP_NOW_SEND_SUCCESS)
+            {
+                twheel_del(&wheel, &channel_timer);
+                wlcon_set_channel(channel_pending);
+                channel_pending = 0;
+            }
+            else
+            {
+                twheel_add(&wheel, &channel_timer, esp_timer_get_time());
+            }
+        }
+    }
+#endif
+}
+
+static void wlcon_recv_cb_handler(const espnow_event_recv_cb_t *recv_cb)
+{
+    wireless_packet_t *packet = (wireless_packet_t *)recv_cb->data;
+    // 有效检测
+    if (!wireless_packet_check(packet, recv_cb->len, recv_cb->crc))
+    {
+        ESP_LOGE(TAG, "Invalid packet received");
+        wlcon_stats.crc_errors++;
+        free_p(packet);
+        mbudget_release(MBUDGET_CB, MBUDGET_CHARGE(recv_cb->len));
+        return;
+    }
+    // 数据包分类处理
+    switch (packet->type)
+    {
+        // 广播包, 用于设备发现，只在广播状态下处理
+    case WIRELESS_PACKET_TYPE_BROADCAST:
+        if (status != WIRELESS_STATUS_BROADCAST)
+        { // 收到广播包是已连接地址发出的，则判定为连接断开
+            if (memcmp(recv_cb->mac_addr, target_mac, WLCON_ADDR_LEN) == 0)
             {
-                send_broadcast_packet();
-                last_broadcast_time = xTaskGetTickCount();
+                // 对端进入广播状态，判定对方掉线重新连接
+                wlcon_disconnect();
             }
+            break;
+        }
+        if (master_ruling_code > packet->payload[0])
+        {
+            is_master = true;
+            wireless_add_peer(recv_cb->mac_addr, false);
+            // 停止广播
+            wlcon_enter_connect();
+        }
+        break;
+    // 连接包, 用于连接建立，只在广播状态下处理
+    case WIRELESS_PACKET_TYPE_CONNECT:
+        if (status != WIRELESS_STATUS_BROADCAST && status != WIRELESS_STATUS_CONNECT_RST)
+        {
+            break;
+        }
+        // 判断是请求包还是应答包
+        if (packet->payload[0] == CON_TYPE_RST) // 请求包
+        {
+            wireless_add_peer(recv_cb->mac_addr, false);
+            connect_code = packet->payload[1];
+#if CONFIG_WLCON_AEAD
+            memcpy(nonce_peer, packet->payload + 2, CONNECT_EXTRA_LEN);
+            aead_random(nonce_local, CONNECT_EXTRA_LEN);
+#endif
+            send_connect_packet(2, connect_code + 1);
         }
-        else if (status == WIRELESS_STATUS_CONNECT_RST)
+        else if (packet->payload[0] == CON_TYPE_ACK) // 应答包
         {
-            if (xTaskGetTickCount() - last_connect_rst_time >= pdMS_TO_TICKS(CONFIG_CONNECT_INTERVAL))
+            // 验证连接校验码
+            if (packet->payload[1] == (uint8_t)(connect_code + 1))
             {
-                if (retry_count >= CONFIG_CONNECT_RETRY)
-                {
-                    // 连接失败, 继续广播
-                    status = WIRELESS_STATUS_BROADCAST;
-                    retry_count = 0;
-                    is_master = false;
-                }
-                connect_code = esp_random() & 0xff;
-                send_connect_packet(1, connect_code);
-                retry_count++;
-                last_connect_rst_time = xTaskGetTickCount();
+#if CONFIG_WLCON_AEAD
+                memcpy(nonce_peer, packet->payload + 2, CONNECT_EXTRA_LEN);
+                aead_derive(nonce_local, nonce_peer);
+#endif
+                send_connect_packet(3, packet->payload[1] + 1);
+                // 进入连接状态
+                wlcon_enter_connected(recv_cb->mac_addr, true);
+            }
+            else
+            {
+                wlcon_enter_broadcast();
             }
         }
-        // 回调处理
-        if (xQueueReceive(espnow_cb_queue, &evt, pdMS_TO_TICKS(1)) == pdTRUE)
+        else if (packet->payload[0] == CON_TYPE_EST) // 连接建立包
         {
-            // 收到数据包
-            if (evt.id == ESPNOW_RECV_CB)
+#if CONFIG_WLCON_AEAD
+            uint8_t confirm[CONNECT_EXTRA_LEN];
+            aead_derive(nonce_peer, nonce_local);
+            aead_confirm_code(packet->payload[1], confirm);
+            if (memcmp(confirm, packet->payload + 2, CONNECT_EXTRA_LEN) != 0)
             {
-                wireless_packet_t *packet = (wireless_packet_t *)evt.info.recv_cb.data;
-                // 有效检测
-                if (!wireless_packet_check(packet))
-                {
-                    ESP_LOGE(TAG, "Invalid packet received");
-                    free_p(packet);
-                    continue; // 多个不相关动作在同一循环中时，慎用continue和break
-                }
-                // 数据包分类处理
-                switch (packet->type)
+                // 预共享密钥不一致
+                ESP_LOGE(TAG, "Session key confirmation failed");
+                wlcon_enter_broadcast();
+                break;
+            }
+#endif
+            if (packet->payload[1] == (uint8_t)(connect_code + 2))
+            {
+                // 进入连接状态
+                wlcon_enter_connected(recv_cb->mac_addr, false);
+            }
+            else
+            {
+                wlcon_enter_broadcast();
+            }
+        }
+        break;
+        // 数据包，用于数据传输，只在连接状态下处理
+    case WIRELESS_PACKET_TYPE_DATA:
+        if (status != WIRELESS_STATUS_CONNECTED)
+        {
+            ESP_LOGD(TAG, "未连接状态下收到数据包，丢弃数据包");
+            break;
+        }
+        wlcon_link_alive();
+        if (packet->length == 0)
+        {
+            // 如果数据包长度为0，是心跳包，回复应答
+            send_heartbeat_packet(2);
+            break;
+        }
+        if (packet->seq == rx_seq)
+        {
+            // 应答丢失，对端以相同序号重传
+            send_ack_packet(packet->seq, false);
+            wlcon_stats.rx_dup++;
+            break;
+        }
+        xQueueHandle recv = packet->stream < WLCON_STREAM_MAX ? streams[packet->stream].recv : NULL;
+        if (recv == NULL)
+        {
+            // 未注册的通道，应答后丢弃，避免对端反复重传
+            ESP_LOGE(TAG, "输出数据到串口队列失败");
+            send_ack_packet(packet->seq, false);
+            rx_seq = packet->seq;
+            break;
+        }
+        // 数据放入接收队列后才应答，接收额度不足时回复忙，对端超时重传但不会放弃
+        uint32_t charge = MBUDGET_CHARGE(packet->length);
+        if (!wlcon_admit(MBUDGET_RX, recv, charge, pdMS_TO_TICKS(10)))
+        {
+            send_ack_packet(packet->seq, true);
+            break;
+        }
+        buf_len_t espnow_serial = {
+            .len = packet->length,
+            .buf = malloc(packet->length),
+            .flag = 0x01,
+        };
+        if (espnow_serial.buf == NULL)
+        {
+            ESP_LOGE(TAG, "内存分配失败!");
+            mbudget_release(MBUDGET_RX, charge);
+            break;
+        }
+        memcpy(espnow_serial.buf, packet->payload, packet->length);
+        if (xQueueSend(recv, &espnow_serial, 0) != pdTRUE)
+        {
+            ESP_LOGE(TAG, "输出数据到串口队列失败");
+            free(espnow_serial.buf);
+            mbudget_release(MBUDGET_RX, charge);
+            mbudget_reject(MBUDGET_RX);
+            break;
+        }
+        send_ack_packet(packet->seq, false);
+        rx_seq = packet->seq;
+        wlcon_stats.rx_frames++;
+        wlcon_stats.rx_bytes += packet->length;
+        break;
+        // 数据应答包，用于数据发送成功的确认，只在连接状态下处理
+    case WIRELESS_PACKET_TYPE_DATA_ACK:
+        if (status != WIRELESS_STATUS_CONNECTED)
+        {
+            ESP_LOGD(TAG, "未连接状态下收到数据应答包，丢弃应答包");
+            break;
+        }
+        wlcon_link_alive();
+        // 心跳应答和过期的应答不影响等待中的数据包
+        if (tx_frame != NULL && packet->seq == tx_seq)
+        {
+            wlcon_stream_t *s = &streams[tx_frame->stream];
+            if (packet->length > 0 && packet->payload[0] == DATA_ACK_BUSY)
+            {
+                // 对端接收额度不足，忙应答不计入重传次数，但总次数有上限，避免一个慢速通道一直占用链路
+                if (++s->busy > CONFIG_WLCON_BUSY_RETRY_MAX)
                 {
-                    // 广播包, 用于设备发现，只在广播状态下处理
-                case WIRELESS_PACKET_TYPE_BROADCAST:
-                    if (status != WIRELESS_STATUS_BROADCAST)
-                    { // 收到广播包是已连接地址发出的，则判定为连接断开
-                        if (memcmp(evt.info.recv_cb.mac_addr, target_mac, ESP_NOW_ETH_ALEN) == 0)
-                        {
-                            // 对端进入广播状态，判定对方掉线重新连接
-                            status = WIRELESS_STATUS_DISCONNECTED;
-                        }
-                        break;
-                    }
-                    if (master_ruling_code > packet->payload[0])
-                    {
-                        is_master = true;
-                        wireless_add_peer(evt.info.recv_cb.mac_addr, false);
-                        // 停止广播
-                        status = WIRELESS_STATUS_CONNECT_RST;
-                    }
-                    break;
-                // 连接包, 用于连接建立，只在广播状态下处理
-                case WIRELESS_PACKET_TYPE_CONNECT:
-                    if (status != WIRELESS_STATUS_BROADCAST && status != WIRELESS_STATUS_CONNECT_RST)
-                    {
-                        break;
-                    }
-                    // 判断是请求包还是应答包
-                    if (packet->payload[0] == CON_TYPE_RST) // 请求包
-                    {
-                        wireless_add_peer(evt.info.recv_cb.mac_addr, false);
-                        connect_code = packet->payload[1];
-                        send_connect_packet(2, connect_code + 1);
-                    }
-                    else if (packet->payload[0] == CON_TYPE_ACK) // 应答包
-                    {
-                        // 验证连接校验码
-                        if (packet->payload[1] == connect_code + 1)
-                        {
-                            send_connect_packet(3, packet->payload[1] + 1);
-                            // 进入连接状态
-                            is_master = true;
-                            printf("Connected.\n");
-                            // 重新建立加密连接
-                            esp_now_del_peer(target_mac);
-                            wireless_add_peer(evt.info.recv_cb.mac_addr, true);
-                            portENTER_CRITICAL();
-                            heartbeat_time = 0;
-                            portEXIT_CRITICAL();
-                            status = WIRELESS_STATUS_CONNECTED;
-                        }
-                        else
-                        {
-                            status = WIRELESS_STATUS_BROADCAST;
-                        }
-                    }
-                    else if (packet->payload[0] == CON_TYPE_EST) // 连接建立包
-                    {
-                        if (packet->payload[1] == connect_code + 2)
-                        {
-                            // 进入连接状态
-                            is_master = false;
-                            status = WIRELESS_STATUS_CONNECTED;
-                            portENTER_CRITICAL();
-                            heartbeat_time = 0;
-                            portEXIT_CRITICAL();
-                            printf("Connected.\n");
-                            esp_now_del_peer(target_mac);
-                            wireless_add_peer(evt.info.recv_cb.mac_addr, true);
-                        }
-                        else
-                        {
-                            status = WIRELESS_STATUS_BROADCAST;
-                        }
-                    }
-                    break;
-                    // 数据包，用于数据传输，只在连接状态下处理
-                case WIRELESS_PACKET_TYPE_DATA:
-                    if (status != WIRELESS_STATUS_CONNECTED)
-                    {
-                        ESP_LOGD(TAG, "未连接状态下收到数据包，丢弃数据包");
-                        break;
-                    }
-                    portENTER_CRITICAL();
-                    heartbeat_time = 0;
-                    portEXIT_CRITICAL();
-                    if (packet->length == 0)
-                    {
-                        // 如果数据包长度为0，是心跳包，回复应答
-                        send_heartbeat_packet(2);
-                        break;
-                    }
-                    buf_len_t espnow_serial = {
-                        .len = packet->length,
-                        .buf = malloc(packet->length),
-                    };
-                    memcpy(espnow_serial.buf, packet->payload, packet->length);
-                    // 发送应答包
-                    send_ack_packet();
-                    if (wlcon_recv_queue == NULL || xQueueSend(wlcon_recv_queue, &espnow_serial, pdMS_TO_TICKS(10)) != pdTRUE)
-                    {
-                        ESP_LOGE(TAG, "输出数据到串口队列失败");
-                        break;
-                    }
-                    break;
-                    // 数据应答包，用于数据发送成功的确认，只在连接状态下处理
-                case WIRELESS_PACKET_TYPE_DATA_ACK:
-                    if (status != WIRELESS_STATUS_CONNECTED)
-                    {
-                        ESP_LOGD(TAG, "未连接状态下收到数据应答包，丢弃应答包");
-                        break;
-                    }
-                    wait_ack = false;
-                    portENTER_CRITICAL();
-                    heartbeat_time = 0;
-                    portEXIT_CRITICAL();
+                    ESP_LOGW(TAG, "Drop data packet %d after %d busy replies", tx_seq, CONFIG_WLCON_BUSY_RETRY_MAX);
+                    wlcon_stats.tx_drop++;
+                    s->busy = 0;
+                    wlcon_drop_tx_frame();
                     break;
                 }
-                // 释放数据包内存，此内存在espnow_recv_cb中分配
-                free_p(packet);
+                tx_retry = 0;
+                wlcon_yield_tx_frame();
+                break;
             }
+            s->busy = 0;
+            wlcon_drop_tx_frame();
+        }
+        break;
+        // 信道切换包，只在连接状态下处理
+    case WIRELESS_PACKET_TYPE_CHANNEL:
+#if CONFIG_WLCON_CHANNEL_AUTO
+        if (status != WIRELESS_STATUS_CONNECTED || memcmp(recv_cb->mac_addr, target_mac, WLCON_ADDR_LEN) != 0)
+        {
+            break;
+        }
+        if (!chanmgr_valid(packet->payload[1]))
+        {
+            ESP_LOGE(TAG, "Invalid channel %d", packet->payload[1]);
+            break;
+        }
+        if (packet->payload[0] == CHAN_TYPE_REQ && !is_master)
+        {
+            // 先在当前信道应答，应答包发送成功后再切换
+            channel_pending = packet->payload[1];
+            channel_ack_retry = 0;
+            channel_ack_send();
+        }
+        else if (packet->payload[0] == CHAN_TYPE_ACK && is_master && packet->payload[1] == channel_target)
+        {
+            twheel_del(&wheel, &channel_timer);
+            wlcon_set_channel(channel_target);
+            channel_target = 0;
         }
+#endif
+        break;
     }
+    // 释放数据包内存，此内存在wlcon_recv_cb中分配
+    free_p(packet);
+    mbudget_release(MBUDGET_CB, MBUDGET_CHARGE(recv_cb->len));
 }
 
-void wlcon_heartbeat_handler(void *pvParameters)
+MBUDGET_TASK_DEFINE(wlcon_con_manager, 2048);
+
+/**
+ * @brief 连接管理任务
+ *
+ * 所有协议超时(广播、连接重试、心跳、应答重传、信道切换)都由时间轮管理，任务只在
+ * 收到无线事件、定时器到期或发送队列有新数据时运行，链路空闲时不占用CPU。
+ */
+void wlcon_con_manager(void *pvParameters)
 {
-    heartbeat_time += 10;
-    heartbeat_interval += 10;
-    if (is_master && status == WIRELESS_STATUS_CONNECTED && heartbeat_time > (CONFIG_HEARTBEAT_INTERVAL))
+    espnow_event_t evt = {0};
+    wlcon_enter_broadcast();
+    while (1)
     {
-        // 发送心跳包
-        if (heartbeat_interval > (CONFIG_HEARTBEAT_INTERVAL))
+        twheel_run(&wheel, esp_timer_get_time());
+        wlcon_send_next();
+#if CONFIG_WLCON_CHANNEL_AUTO
+        wlcon_channel_poll();
+#endif
+        wlcon_wheel_arm();
+        if (xQueueReceive(espnow_cb_queue, &evt, portMAX_DELAY) != pdTRUE)
         {
-            heartbeat_interval = 0; // 重置心跳发送间隔
-            send_heartbeat_packet(1);
+            continue;
+        }
+        switch (evt.id)
+        {
+        case ESPNOW_TIMER_EVT:
+            // 单次定时器已触发，由wlcon_wheel_arm重新设定
+            timer_evt_pending = false;
+            break;
+        case ESPNOW_TX_EVT:
+            tx_evt_pending = false;
+            break;
+        case ESPNOW_SEND_CB:
+            wlcon_send_cb_handler(&evt.info.send_cb);
+            break;
+        case ESPNOW_RECV_CB:
+            wlcon_recv_cb_handler(&evt.info.recv_cb);
+            break;
         }
     }
 }
@@ -627,19 +1591,108 @@ void wifi_init(void)
     ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
     ESP_ERROR_CHECK(esp_wifi_set_mode(ESPNOW_WIFI_MODE));
     ESP_ERROR_CHECK(esp_wifi_start());
+#if !CONFIG_WLCON_TRANSPORT_UDP
+    // UDP模式下信道由AP决定
     ESP_ERROR_CHECK(esp_wifi_set_channel(CONFIG_ESPNOW_CHANNEL, 0));
+#endif
 
     initialized = true;
 }
 
+/**
+ * @brief 注册一个逻辑通道
+ *
+ * 每个通道有独立的收发队列，队列元素为buf_len_t。发送时priority大的通道总是优先，
+ * 相同priority的通道按weight分配带宽。对端收到的数据按通道号放入对应的接收队列，
+ * 两端应注册相同的通道。
+ *
+ * @param stream 通道号，小于WLCON_STREAM_MAX
+ * @param weight 带宽权重，不能为0
+ */
+esp_err_t wlcon_stream_register(uint8_t stream, xQueueHandle send, xQueueHandle recv, uint8_t priority, uint8_t weight)
+{
+    if (stream >= WLCON_STREAM_MAX || weight == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (send == NULL || recv == NULL)
+    {
+        ESP_LOGW(TAG, "There are unconfigured input and output queues on stream %d.", stream);
+    }
+    portENTER_CRITICAL();
+    streams[stream].priority = priority;
+    streams[stream].weight = weight;
+    streams[stream].deficit = 0;
+    streams[stream].busy = 0;
+    streams[stream].recv = recv;
+    streams[stream].send = send;
+    portEXIT_CRITICAL();
+    return ESP_OK;
+}
+
+// 注册串口透传通道
 void wlcon_io_register(xQueueHandle send, xQueueHandle recv)
 {
-    wlcon_send_queue = send;
-    wlcon_recv_queue = recv;
-    if (wlcon_send_queue == NULL || wlcon_recv_queue == NULL)
+    wlcon_stream_register(WLCON_STREAM_DATA, send, recv, 0, 1);
+}
+
+/**
+ * @brief 把数据放入通道的发送队列并唤醒连接管理任务
+ *
+ * 数据计入发送阶段的额度，额度不足时按CONFIG_WLCON_MEM_TX_*策略处理。
+ *
+ * @return false 通道未注册、额度不足或发送队列已满，data未被接收
+ */
+bool wlcon_stream_send(uint8_t stream, const buf_len_t *data, TickType_t ticks_to_wait)
+{
+    if (stream >= WLCON_STREAM_MAX || streams[stream].send == NULL)
+    {
+        return false;
+    }
+    if (data->len > wlcon_max_payload())
+    {
+        ESP_LOGE(TAG, "Stream %d data too long: %d > %d", stream, data->len, (int)wlcon_max_payload());
+        return false;
+    }
+    uint32_t charge = MBUDGET_CHARGE(data->len);
+    if (!wlcon_admit(MBUDGET_TX, streams[stream].send, charge, ticks_to_wait))
+    {
+        return false;
+    }
+    if (xQueueSend(streams[stream].send, data, ticks_to_wait) != pdTRUE)
+    {
+        mbudget_release(MBUDGET_TX, charge);
+        mbudget_reject(MBUDGET_TX);
+        return false;
+    }
+    wlcon_post_event(ESPNOW_TX_EVT, &tx_evt_pending);
+    return true;
+}
+
+bool wlcon_send(const buf_len_t *data, TickType_t ticks_to_wait)
+{
+    return wlcon_stream_send(WLCON_STREAM_DATA, data, ticks_to_wait);
+}
+
+/**
+ * @brief 从通道的接收队列取出数据，释放其接收额度
+ *
+ * 接收队列只能通过此函数读取，data->buf由调用者释放。
+ */
+bool wlcon_stream_recv(uint8_t stream, buf_len_t *data, TickType_t ticks_to_wait)
+{
+    if (stream >= WLCON_STREAM_MAX || streams[stream].recv == NULL ||
+        xQueueReceive(streams[stream].recv, data, ticks_to_wait) != pdTRUE)
     {
-        ESP_LOGW(TAG, "There are unconfigured input and output queues.");
+        return false;
     }
+    mbudget_release(MBUDGET_RX, MBUDGET_CHARGE(data->len));
+    return true;
+}
+
+bool wlcon_recv(buf_len_t *data, TickType_t ticks_to_wait)
+{
+    return wlcon_stream_recv(WLCON_STREAM_DATA, data, ticks_to_wait);
 }
 
 bool wlcon_is_connected()
@@ -649,61 +1702,81 @@ bool wlcon_is_connected()
     return true;
 }
 
+bool wlcon_is_master()
+{
+    return is_master;
+}
+
+void wlcon_get_stats(wlcon_stats_t *stats)
+{
+    portENTER_CRITICAL();
+    *stats = wlcon_stats;
+    portEXIT_CRITICAL();
+}
+
 esp_err_t wlcon_init(void)
 {
+    // 数据包缓冲区按WLCON_TRANSPORT_MTU分配，传输层的MTU不能更大
+    if (transport->mtu > WLCON_TRANSPORT_MTU || transport->mtu <= sizeof(wireless_packet_t) + WLCON_AEAD_OVERHEAD)
+    {
+        ESP_LOGE(TAG, "Invalid %s transport mtu: %d", transport->name, (int)transport->mtu);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t ret = mbudget_init();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
     // 创建队列
-    espnow_cb_queue = xQueueCreate(ESPNOW_CB_QUEUE_SIZE, sizeof(espnow_event_t));
+    espnow_cb_queue = MBUDGET_QUEUE_CREATE(espnow_cb_queue, ESPNOW_CB_QUEUE_SIZE, sizeof(espnow_event_t));
     if (espnow_cb_queue == NULL)
     {
         ESP_LOGE(TAG, "Create queue fail");
         return ESP_FAIL;
     }
+    crc16_init();
     wlcon_create_packet();
-    // 初始化ESP_NOW
-    ESP_ERROR_CHECK(esp_now_init());
-    ESP_ERROR_CHECK(esp_now_register_send_cb(espnow_send_cb));
-    ESP_ERROR_CHECK(esp_now_register_recv_cb(espnow_recv_cb));
-    ESP_ERROR_CHECK(esp_now_set_pmk((uint8_t *)CONFIG_ESPNOW_PMK));
-
-    // 添加广播地址为peer
-    esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
-    if (peer == NULL)
+    // 初始化协议定时器
+    twheel_init(&wheel, esp_timer_get_time());
+    twheel_timer_init(&broadcast_timer, broadcast_timeout, NULL);
+    twheel_timer_init(&connect_timer, connect_timeout, NULL);
+    twheel_timer_init(&heartbeat_tx_timer, heartbeat_tx_timeout, NULL);
+    twheel_timer_init(&heartbeat_rx_timer, heartbeat_rx_timeout, NULL);
+    twheel_timer_init(&retrans_timer, retrans_timeout, NULL);
+#if CONFIG_WLCON_CHANNEL_AUTO
+    twheel_timer_init(&channel_timer, channel_timeout, NULL);
+    wlcon_channel_scan();
+#endif
+    // 初始化传输层
+    ret = transport->init(wlcon_send_cb, wlcon_recv_cb);
+    if (ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "Malloc peer information fail");
+        ESP_LOGE(TAG, "Init %s transport fail: %s", transport->name, esp_err_to_name(ret));
         vQueueDelete(espnow_cb_queue);
-        esp_now_deinit();
-        return ESP_FAIL;
+        return ret;
     }
-    memset(peer, 0, sizeof(esp_now_peer_info_t));
-    peer->channel = CONFIG_ESPNOW_CHANNEL;
-    peer->ifidx = ESPNOW_WIFI_IF;
-    peer->encrypt = false;
-    memcpy(peer->peer_addr, broadcast_mac, ESP_NOW_ETH_ALEN);
-    ESP_ERROR_CHECK(esp_now_add_peer(peer));
-    free(peer);
 
-    // 创建心跳定时器
+    // 创建协议定时器，只在时间轮中最近的到期时间触发
     esp_timer_init();
     esp_timer_create_args_t timer_args = {
-        .callback = &wlcon_heartbeat_handler, // 心跳定时器回调函数
-        .name = "heartbeat_timer",
+        .callback = &wlcon_wheel_handler,
+        .name = "wlcon_timer",
         .arg = NULL,
         .dispatch_method = ESP_TIMER_TASK,
     };
-    esp_err_t ret = esp_timer_create(&timer_args, &heartbeat_timer);
+    ret = esp_timer_create(&timer_args, &wheel_timer);
     if (ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "Create heartbeat timer fail: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Create protocol timer fail: %s", esp_err_to_name(ret));
         return ret;
     }
-    // 获取ESP_NOW版本
-    uint32_t esp_now_version;
-    esp_now_get_version(&esp_now_version);
-    ESP_LOGI(TAG, "ESP-NOW Version: %d", esp_now_version);
-
     master_ruling_code = esp_random() & 0xff;
 
-    xTaskCreate(wlcon_con_manager, "wlcon_con_manager", 2048, NULL, wlcon_manager_priority, &wlcon_manager_handle);
+    wlcon_manager_handle = MBUDGET_TASK_CREATE(wlcon_con_manager, NULL, wlcon_manager_priority);
+    if (wlcon_manager_handle == NULL)
+    {
+        return ESP_FAIL;
+    }
     // 开始广播
     printf("Broadcast.\n");
     return ESP_OK;
@@ -8,15 +8,32 @@
 #define ESPNOW_WIFI_IF ESP_IF_WIFI_AP
 #endif
 
-#define ESPNOW_CB_QUEUE_SIZE 8
-#define WIRELESS_PACKET_VERSION 1U
-#define IS_BROADCAST_ADDR(addr) (memcmp(addr, broadcast_mac, ESP_NOW_ETH_ALEN) == 0)
+// 回调事件队列长度，缓存的接收帧另由内存预算按字节限制
+#define ESPNOW_CB_QUEUE_SIZE 32
+#define WIRELESS_PACKET_VERSION 4U
+// 单个无线帧可承载的最大串口数据长度
+#define WIRELESS_PACKET_MAX_PAYLOAD_SIZE (WLCON_TRANSPORT_MTU - sizeof(wireless_packet_t) - WLCON_AEAD_OVERHEAD)
+#define IS_BROADCAST_ADDR(addr) (memcmp(addr, broadcast_mac, WLCON_ADDR_LEN) == 0)
+// 逻辑通道(流)数量，各自有独立的收发队列，共用一条无线链路
+#define WLCON_STREAM_MAX 4
+#define WLCON_STREAM_DATA 0 // 串口透传
+#define WLCON_STREAM_DIAG 1 // 诊断通道
 
 #include "esp_system.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "esp_now.h"
+#include "transport.h"
+
+#if CONFIG_WLCON_AEAD
+// 会话加密时帧尾附加的帧计数(4字节)和截短的认证标签
+#define WLCON_AEAD_TAG_LEN 8
+#define WLCON_AEAD_OVERHEAD (4 + WLCON_AEAD_TAG_LEN)
+#else
+#define WLCON_AEAD_OVERHEAD 0
+#endif
 // 无线通信状态
 typedef enum
 {
@@ -35,6 +52,7 @@ typedef enum
     WIRELESS_PACKET_TYPE_CONNECT,       // 连接包
     WIRELESS_PACKET_TYPE_DATA,          // 数据包
     WIRELESS_PACKET_TYPE_DATA_ACK,      // 数据应答包
+    WIRELESS_PACKET_TYPE_CHANNEL,       // 信道切换包
     // WIRELESS_PACKET_TYPE_MAX_INDEX,
 } wireless_packet_type_t;
 
@@ -45,6 +63,8 @@ typedef struct
     wireless_packet_type_t type;
     uint32_t length;    // 数据长度
     uint16_t crc;       // 校验和
+    uint16_t seq;       // 数据包序号，应答包原样返回，心跳为0
+    uint8_t stream;     // 逻辑通道号，控制包为0
     uint8_t payload[0]; // 数据
 } __attribute__((packed)) wireless_packet_t;
 
@@ -58,20 +78,24 @@ typedef struct
 typedef enum
 {
     ESPNOW_SEND_CB,
-    ESPNOW_RECV_CB
+    ESPNOW_RECV_CB,
+    ESPNOW_TIMER_EVT, // 协议定时器到期
+    ESPNOW_TX_EVT,    // 发送队列有新数据
 } espnow_event_id_t;
 
 typedef struct
 {
-    uint8_t mac_addr[ESP_NOW_ETH_ALEN];
+    uint8_t mac_addr[WLCON_ADDR_LEN];
     esp_now_send_status_t status;
+    uint32_t id; // 发送序号，每帧一个回调，与发送顺序一致
 } espnow_event_send_cb_t;
 
 typedef struct
 {
-    uint8_t mac_addr[ESP_NOW_ETH_ALEN];
+    uint8_t mac_addr[WLCON_ADDR_LEN];
     uint8_t *data;
     int len;
+    uint16_t crc; // 接收回调复制数据时计算的CRC
 } espnow_event_recv_cb_t;
 
 typedef union
@@ -86,8 +110,30 @@ typedef struct
     espnow_event_info_t info;
 } espnow_event_t;
 
+// 链路统计计数，只由连接管理任务更新
+typedef struct
+{
+    uint32_t tx_frames;   // 发出的数据帧
+    uint32_t tx_bytes;    // 发出的串口数据字节
+    uint32_t tx_fail;     // 传输层发送调用失败
+    uint32_t tx_cb_fail;  // 发送回调报告失败(ESP-NOW的MAC层重试耗尽)
+    uint32_t rx_frames;   // 收到的数据帧
+    uint32_t rx_bytes;    // 收到的串口数据字节
+    uint32_t crc_errors;  // 校验失败丢弃的帧
+    uint32_t tx_retrans;  // 应答超时重传的数据帧
+    uint32_t tx_drop;     // 重传次数耗尽丢弃的数据帧
+    uint32_t rx_dup;      // 收到的重复数据帧(应答丢失后的重传)
+} wlcon_stats_t;
+
 void wifi_init(void);
 esp_err_t wlcon_init(void);
 void wlcon_io_register(xQueueHandle send, xQueueHandle recv);
+esp_err_t wlcon_stream_register(uint8_t stream, xQueueHandle send, xQueueHandle recv, uint8_t priority, uint8_t weight);
+bool wlcon_send(const buf_len_t *data, TickType_t ticks_to_wait);
+bool wlcon_stream_send(uint8_t stream, const buf_len_t *data, TickType_t ticks_to_wait);
+bool wlcon_recv(buf_len_t *data, TickType_t ticks_to_wait);
+bool wlcon_stream_recv(uint8_t stream, buf_len_t *data, TickType_t ticks_to_wait);
 bool wlcon_is_connected();
+bool wlcon_is_master();
+void wlcon_get_stats(wlcon_stats_t *stats);
 #endif
\ No newline at end of file
@@ -0,0 +1,168 @@
+/*
+ * 信道管理主机端测试
+ *
+ * 编译运行：cc -Imain tools/chanmgr_test.c main/chanmgr.c -o chanmgr_test && ./chanmgr_test
+ *
+ * 用模拟的扫描结果和按信道设定丢包率的随机发送结果驱动chanmgr，按wlcon的方式每帧记录、
+ * 每帧检查并立即切换。检查连接后按扫描结果选择空闲信道、丢包低于阈值时不切换、
+ * 拥塞时切换到不受干扰的信道且不来回切换，以及非法信道号被拒绝。
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "chanmgr.h"
+
+// 与CONFIG_WLCON_CHANNEL_LOSS_THRESHOLD的默认值相同，千分比
+#define TEST_LOSS_THRESHOLD 200
+#define TEST_WINDOWS 200
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+ * @brief 按各信道的丢包率(千分比)模拟发送frames帧
+ *
+ * @return 切换次数，channel为最后所在的信道
+ */
+static int simulate(chanmgr_t *cm, const uint16_t *loss, int frames, uint8_t *channel)
+{
+    int switches = 0;
+    for (int i = 0; i < frames; i++)
+    {
+        chanmgr_record(cm, rng_next() % 1000 < loss[cm->current]);
+        uint8_t target = chanmgr_check(cm);
+        if (target != 0)
+        {
+            if (!chanmgr_valid(target))
+            {
+                printf("invalid target channel %d\n", target);
+                return -1;
+            }
+            chanmgr_switched(cm, target);
+            switches++;
+        }
+    }
+    *channel = cm->current;
+    return switches;
+}
+
+static int test_valid(void)
+{
+    int errors = 0;
+    static const uint8_t bad[] = {0, 14, 15, 255};
+    for (size_t i = 0; i < sizeof(bad); i++)
+        errors += chanmgr_valid(bad[i]);
+    for (uint8_t c = CHANMGR_MIN_CHANNEL; c <= CHANMGR_MAX_CHANNEL; c++)
+        errors += !chanmgr_valid(c);
+    // 非法信道的扫描结果不计入
+    chanmgr_t cm;
+    chanmgr_init(&cm, 1, TEST_LOSS_THRESHOLD);
+    chanmgr_add_scan(&cm, 0, -30);
+    chanmgr_add_scan(&cm, 14, -30);
+    errors += cm.scanned;
+    if (errors != 0)
+        printf("valid: %d errors\n", errors);
+    return errors;
+}
+
+// 连接后按扫描结果切换到不与任何AP重叠的信道
+static int test_scan(void)
+{
+    chanmgr_t cm;
+    chanmgr_init(&cm, 1, TEST_LOSS_THRESHOLD);
+    chanmgr_add_scan(&cm, 1, -40);
+    chanmgr_add_scan(&cm, 6, -50);
+    chanmgr_add_scan(&cm, 6, -70);
+    chanmgr_connected(&cm);
+    uint8_t target = chanmgr_check(&cm);
+    if (target != 11)
+    {
+        printf("scan: expect channel 11, got %d\n", target);
+        return 1;
+    }
+    // 只在刚连接时按扫描结果选择一次
+    chanmgr_switched(&cm, target);
+    if (chanmgr_check(&cm) != 0)
+    {
+        printf("scan: switched twice\n");
+        return 1;
+    }
+    return 0;
+}
+
+// 丢包率低于阈值时保持当前信道
+static int test_below_threshold(void)
+{
+    static uint16_t loss[CHANMGR_MAX_CHANNEL + 1];
+    chanmgr_t cm;
+    uint8_t channel;
+    for (int c = 0; c <= CHANMGR_MAX_CHANNEL; c++)
+        loss[c] = TEST_LOSS_THRESHOLD / 2;
+    chanmgr_init(&cm, 1, TEST_LOSS_THRESHOLD);
+    int switches = simulate(&cm, loss, TEST_WINDOWS * CHANMGR_WINDOW, &channel);
+    if (switches != 0)
+    {
+        printf("below threshold: %d switches\n", switches);
+        return 1;
+    }
+    return 0;
+}
+
+// 1~8信道拥塞，应离开并停在9~13信道，不来回切换
+static int test_congested(void)
+{
+    static uint16_t loss[CHANMGR_MAX_CHANNEL + 1];
+    chanmgr_t cm;
+    uint8_t channel;
+    for (int c = 0; c <= CHANMGR_MAX_CHANNEL; c++)
+        loss[c] = c <= 8 ? 400 : 20;
+    chanmgr_init(&cm, 1, TEST_LOSS_THRESHOLD);
+    int switches = simulate(&cm, loss, TEST_WINDOWS * CHANMGR_WINDOW, &channel);
+    printf("congested: %d switches, settled on channel %d\n", switches, channel);
+    if (switches < 1 || switches > 3 || channel < 9)
+        return 1;
+    return 0;
+}
+
+// 切换后的保持窗口内即使丢包严重也不再切换，保持结束后立即切换
+static int test_hold(void)
+{
+    static uint16_t loss[CHANMGR_MAX_CHANNEL + 1];
+    chanmgr_t cm;
+    uint8_t channel;
+    for (int c = 0; c <= CHANMGR_MAX_CHANNEL; c++)
+        loss[c] = 1000;
+    chanmgr_init(&cm, 1, TEST_LOSS_THRESHOLD);
+    chanmgr_switched(&cm, 1);
+    int switches = simulate(&cm, loss, CHANMGR_HOLD_WINDOWS * CHANMGR_WINDOW - 1, &channel);
+    if (switches != 0)
+    {
+        printf("hold: %d switches within %d windows\n", switches, CHANMGR_HOLD_WINDOWS);
+        return 1;
+    }
+    if (simulate(&cm, loss, 1, &channel) != 1)
+    {
+        printf("hold: no switch after %d windows\n", CHANMGR_HOLD_WINDOWS);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int errors = 0;
+    errors += test_valid();
+    errors += test_scan();
+    errors += test_below_threshold();
+    errors += test_congested();
+    errors += test_hold();
+    printf("check: %s\n", errors == 0 ? "ok" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,414 @@
+/*
+ * 串口消息边界检测主机端测试
+ *
+ * 编译运行：cc -Imain tools/framer_test.c main/framer.c main/serial_timing.c -o framer_test && ./framer_test
+ *
+ * 模拟串口驱动的上报方式：接收FIFO达到UART_RXFIFO_FULL_THRESH或线路空闲超过接收超时时上报一批数据，
+ * 按uart_rx_task相同的方式交给framer_stream，没有数据时每1ms轮询一次。
+ * 检查各检测器拆出的无线帧与原消息是否一致，以及消息最后一个字节到发出无线帧的延迟：
+ * 有字节级边界的消息应在上报最后一个字节的那一批数据中立即发出，Modbus RTU在帧间隔后发出，
+ * 没有结尾的消息在确认空闲超时后发出。
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "framer.h"
+#include "serial_timing.h"
+
+#define UART_RXFIFO_FULL_THRESH 100
+// 保留字节间隔时的FIFO阈值与空闲发送时间，与main.c相同
+#define TIMING_RXFIFO_FULL_THRESH 16
+#define TIMING_FLUSH_IDLE_US 1000
+#define UART_RX_TOUT_DEFAULT 2
+#define UART_RX_TOUT_MAX 127
+#define FRAMER_IDLE_US 20000
+#define POLL_US 1000
+// ESP-NOW单帧的负载长度
+#define FRAME_CAP 233
+#define SIM_MAX 2048
+#define EMIT_MAX 32
+
+// 消息的发出方式
+typedef enum
+{
+    EXPECT_BOUNDARY, // 上报最后一个字节时立即发出
+    EXPECT_GAP,      // 帧间隔之后发出
+    EXPECT_IDLE,     // 空闲超时后发出
+} expect_kind_t;
+
+typedef struct
+{
+    size_t len;
+    expect_kind_t kind;
+} expect_t;
+
+// 模拟的串口输入，每个字节接收完成的时间与上报时间
+static uint8_t sim_data[SIM_MAX];
+static int64_t sim_end[SIM_MAX];
+static int64_t sim_report[SIM_MAX];
+static size_t sim_len;
+static int64_t sim_now;
+static uint32_t char_us;
+static uint32_t fifo_full;
+
+static struct
+{
+    uint8_t data[FRAME_CAP];
+    size_t len;
+    int64_t at;
+} emits[EMIT_MAX];
+static size_t emit_count;
+
+static void emit(const uint8_t *data, size_t len)
+{
+    if (emit_count < EMIT_MAX)
+    {
+        memcpy(emits[emit_count].data, data, len);
+        emits[emit_count].len = len;
+        emits[emit_count].at = sim_now;
+    }
+    emit_count++;
+}
+
+static void sim_reset(uint32_t baud)
+{
+    sim_len = 0;
+    sim_now = 0;
+    emit_count = 0;
+    char_us = 10 * 1000000 / baud;
+    fifo_full = UART_RXFIFO_FULL_THRESH;
+}
+
+// 线路空闲gap_us后连续发送len字节
+static void sim_write(const void *data, size_t len, uint32_t gap_us)
+{
+    int64_t t = sim_len > 0 ? sim_end[sim_len - 1] : 1000;
+    t += gap_us;
+    for (size_t i = 0; i < len && sim_len < SIM_MAX; i++)
+    {
+        t += char_us;
+        sim_data[sim_len] = ((const uint8_t *)data)[i];
+        sim_end[sim_len++] = t;
+    }
+}
+
+static void sim_poll_until(framer_stream_t *s, int64_t t)
+{
+    static int64_t next_poll;
+    if (sim_now == 0)
+        next_poll = POLL_US;
+    while (next_poll < t)
+    {
+        sim_now = next_poll;
+        framer_stream_poll(s, sim_now);
+        next_poll += POLL_US;
+    }
+}
+
+static void sim_run(framer_stream_t *s, uint32_t tout)
+{
+    const int64_t tout_us = (int64_t)tout * char_us;
+    size_t start = 0;
+    while (start < sim_len)
+    {
+        // 找到驱动下一次上报：FIFO达到阈值，或者下一个字节之前线路空闲超过接收超时
+        size_t end = start;
+        int64_t at;
+        while (1)
+        {
+            if (end + 1 - start >= fifo_full)
+            {
+                at = sim_end[end];
+                break;
+            }
+            if (end + 1 == sim_len || sim_end[end + 1] - char_us - sim_end[end] >= tout_us)
+            {
+                at = sim_end[end] + tout_us;
+                break;
+            }
+            end++;
+        }
+        end++;
+        sim_poll_until(s, at);
+        sim_now = at;
+        size_t size = end - start;
+        for (size_t i = start; i < end; i++)
+            sim_report[i] = at;
+        // 与uart_rx_task相同：不足FIFO阈值的一批以接收超时结尾
+        uint32_t idle_us = size < fifo_full ? tout_us : 0;
+        framer_stream_push(s, sim_data + start, size, at - idle_us, idle_us);
+        start = end;
+    }
+    sim_poll_until(s, sim_now + 100000);
+}
+
+static int run_case(const char *name, framer_type_t type, uint8_t delimiter, uint32_t baud,
+                    const expect_t *expect, size_t expect_count)
+{
+    static uint8_t frame[FRAME_CAP];
+    framer_stream_t s;
+    framer_stream_init(&s, type, delimiter, frame, sizeof(frame), emit);
+    s.char_us = char_us;
+    s.flush_chunk = type == FRAMER_TYPE_NONE;
+    uint32_t gap_us = framer_gap_us(&s.framer, baud);
+    uint32_t tout = gap_us > 0 ? gap_us / char_us : UART_RX_TOUT_DEFAULT;
+    if (tout == 0)
+        tout = 1;
+    if (tout > UART_RX_TOUT_MAX)
+        tout = UART_RX_TOUT_MAX;
+    s.report_us = (fifo_full + tout) * char_us;
+    s.idle_us = gap_us > 0 ? tout * char_us : FRAMER_IDLE_US;
+    sim_run(&s, tout);
+
+    int errors = 0;
+    size_t pos = 0;
+    int64_t worst = 0;
+    if (emit_count != expect_count)
+    {
+        printf("%s: %zu frames, expect %zu\n", name, emit_count, expect_count);
+        errors++;
+    }
+    for (size_t i = 0; i < expect_count && i < emit_count && i < EMIT_MAX; i++)
+    {
+        const expect_t *e = &expect[i];
+        if (emits[i].len != e->len || memcmp(emits[i].data, sim_data + pos, e->len) != 0)
+        {
+            printf("%s: frame %zu: %zu bytes, expect %zu bytes at offset %zu\n", name, i, emits[i].len, e->len, pos);
+            errors++;
+            break;
+        }
+        size_t last = pos + e->len - 1;
+        int64_t latency = emits[i].at - sim_end[last];
+        bool ok;
+        switch (e->kind)
+        {
+        case EXPECT_BOUNDARY:
+            ok = emits[i].at == sim_report[last];
+            break;
+        case EXPECT_GAP:
+            ok = latency + char_us > gap_us && latency <= gap_us;
+            break;
+        default:
+            ok = latency >= s.idle_us && latency <= s.idle_us + s.report_us + POLL_US;
+            break;
+        }
+        if (!ok)
+        {
+            printf("%s: frame %zu: latency %lld us (reported %lld us after end)\n", name, i,
+                   (long long)latency, (long long)(sim_report[last] - sim_end[last]));
+            errors++;
+        }
+        if (latency > worst)
+            worst = latency;
+        pos += e->len;
+    }
+    printf("%-14s %2zu frames, worst flush latency %6lld us: %s\n", name, emit_count, (long long)worst,
+           errors == 0 ? "ok" : "FAILED");
+    return errors;
+}
+
+static int test_delimiter(void)
+{
+    static const expect_t expect[] = {
+        {8, EXPECT_BOUNDARY}, {4, EXPECT_BOUNDARY}, {4, EXPECT_BOUNDARY}, {4, EXPECT_BOUNDARY},
+        {FRAME_CAP, EXPECT_BOUNDARY}, {300 - FRAME_CAP, EXPECT_BOUNDARY}, {8, EXPECT_IDLE},
+    };
+    uint8_t line[300];
+    memset(line, 'a', sizeof(line));
+    line[sizeof(line) - 1] = '\n';
+    sim_reset(115200);
+    // 连续发送的两条消息、同一批中的两条消息、超过一帧的长消息和没有结尾的提示符
+    sim_write("AT+GMR\r\nOK\r\n", 12, 0);
+    sim_write("x=1\ny=2\n", 8, 5000);
+    sim_write(line, sizeof(line), 3000);
+    sim_write("prompt> ", 8, 2000);
+    return run_case("delimiter", FRAMER_TYPE_DELIMITER, '\n', 115200, expect, sizeof(expect) / sizeof(expect[0]));
+}
+
+static int test_slip(void)
+{
+    static const uint8_t stream[] = {0xC0, 'a', 'b', 0xDB, 0xDC, 0xC0, 0xC0, 'c', 0xDB, 0xDD, 0xC0, 'd', 0xC0};
+    static const expect_t expect[] = {{6, EXPECT_BOUNDARY}, {5, EXPECT_BOUNDARY}, {2, EXPECT_BOUNDARY}};
+    sim_reset(115200);
+    sim_write(stream, sizeof(stream), 0);
+    return run_case("slip", FRAMER_TYPE_SLIP, 0, 115200, expect, sizeof(expect) / sizeof(expect[0]));
+}
+
+static int test_cobs(void)
+{
+    static const uint8_t a[] = {0x03, 0x11, 0x22, 0x02, 0x33, 0x00, 0x01, 0x01, 0x00};
+    static const uint8_t b[] = {0x05, 0x11, 0x22, 0x33, 0x44, 0x00};
+    static const expect_t expect[] = {{6, EXPECT_BOUNDARY}, {3, EXPECT_BOUNDARY}, {6, EXPECT_BOUNDARY}};
+    sim_reset(115200);
+    sim_write(a, sizeof(a), 0);
+    sim_write(b, sizeof(b), 400);
+    return run_case("cobs", FRAMER_TYPE_COBS, 0, 115200, expect, sizeof(expect) / sizeof(expect[0]));
+}
+
+static int test_mavlink(void)
+{
+    // 线路噪声，v1(负载3字节)，v2(负载2字节)，带签名的v2(负载1字节)，连续发送
+    static const uint8_t noise[] = {0x55, 0xAA};
+    static const uint8_t v1[] = {0xFE, 3, 0, 1, 1, 0, 0x10, 0x20, 0x30, 0xAB, 0xCD};
+    static const uint8_t v2[] = {0xFD, 2, 0, 0, 1, 1, 1, 0, 0, 0, 0xFD, 0xFE, 0xAB, 0xCD};
+    uint8_t v2s[12 + 1 + 13];
+    static const expect_t expect[] = {
+        {sizeof(noise) + sizeof(v1), EXPECT_BOUNDARY}, {sizeof(v2), EXPECT_BOUNDARY},
+        {sizeof(v2s), EXPECT_BOUNDARY}, {sizeof(v1), EXPECT_BOUNDARY},
+    };
+    memset(v2s, 0xFE, sizeof(v2s));
+    v2s[0] = 0xFD;
+    v2s[1] = 1;
+    v2s[2] = 0x01;
+    sim_reset(115200);
+    sim_write(noise, sizeof(noise), 0);
+    sim_write(v1, sizeof(v1), 0);
+    sim_write(v2, sizeof(v2), 0);
+    sim_write(v2s, sizeof(v2s), 0);
+    sim_write(v1, sizeof(v1), 10000);
+    return run_case("mavlink", FRAMER_TYPE_MAVLINK, 0, 115200, expect, sizeof(expect) / sizeof(expect[0]));
+}
+
+static int test_modbus(uint32_t baud)
+{
+    static const uint8_t request[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0xC4, 0x0B};
+    static const uint8_t response[] = {0x01, 0x03, 0x04, 0x00, 0x01, 0x00, 0x02, 0x2A, 0x32};
+    static const expect_t expect[] = {{8, EXPECT_GAP}, {9, EXPECT_GAP}, {8, EXPECT_GAP}, {8, EXPECT_GAP}};
+    char name[32];
+    sim_reset(baud);
+    framer_t f;
+    framer_init(&f, FRAMER_TYPE_MODBUS_RTU, 0);
+    uint32_t gap_us = framer_gap_us(&f, baud);
+    // 帧间隔刚好达到3.5个字符；应答中间有1个字符的停顿，不应拆开；
+    // 前两帧在5ms内到达，按固定周期轮询读取时会被合并
+    sim_write(request, sizeof(request), 0);
+    sim_write(response, 4, gap_us);
+    sim_write(response + 4, sizeof(response) - 4, char_us);
+    sim_write(request, sizeof(request), gap_us);
+    sim_write(request, sizeof(request), 20000);
+    snprintf(name, sizeof(name), "modbus %u", baud);
+    return run_case(name, FRAMER_TYPE_MODBUS_RTU, 0, baud, expect, sizeof(expect) / sizeof(expect[0]));
+}
+
+static int test_none(void)
+{
+    // 不检测边界时每批数据立即发送，连续数据按FIFO阈值分批
+    static const expect_t expect[] = {
+        {UART_RXFIFO_FULL_THRESH, EXPECT_BOUNDARY}, {UART_RXFIFO_FULL_THRESH, EXPECT_BOUNDARY},
+        {50, EXPECT_BOUNDARY}, {5, EXPECT_BOUNDARY},
+    };
+    uint8_t data[250];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = i;
+    sim_reset(115200);
+    sim_write(data, sizeof(data), 0);
+    sim_write("hello", 5, 1000);
+    return run_case("none", FRAMER_TYPE_NONE, 0, 115200, expect, sizeof(expect) / sizeof(expect[0]));
+}
+
+/*
+ * 保留字节间隔：解码各帧还原每个字节之前的空闲，一个字符以上的停顿误差不超过一个字符，
+ * 超过TIMING_GAP_MAX_US的按最大值回放；连续数据装满无线帧，短停顿不拆帧。
+ */
+static int test_timing(void)
+{
+    static const uint8_t esc[] = {0xFF, 0x00, 0xFF, 0x01, 0x02};
+    static uint8_t frame[FRAME_CAP];
+    uint8_t data[300];
+    int errors = 0;
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = i & 0x7F;
+    sim_reset(115200);
+    fifo_full = TIMING_RXFIFO_FULL_THRESH;
+    sim_write(data, sizeof(data), 0);
+    sim_write(esc, sizeof(esc), 2 * char_us);
+    sim_write(data, 5, char_us);
+    sim_write(data, 10, 500);
+    sim_write(data, 3, 5000);
+    sim_write(esc, 4, 40000);
+
+    framer_stream_t s;
+    framer_stream_init(&s, FRAMER_TYPE_NONE, 0, frame, sizeof(frame), emit);
+    s.char_us = char_us;
+    s.timing = true;
+    s.idle_us = TIMING_FLUSH_IDLE_US;
+    s.report_us = (fifo_full + 1) * char_us;
+    sim_run(&s, 1);
+
+    // 各帧依次解码，gap记录每个字节之前的空闲
+    static uint8_t out[FRAME_CAP];
+    static uint32_t gap[SIM_MAX];
+    size_t count = 0;
+    uint32_t pending = 0;
+    for (size_t i = 0; i < emit_count && i < EMIT_MAX; i++)
+    {
+        size_t pos = 0;
+        while (pos < emits[i].len)
+        {
+            size_t out_len;
+            uint32_t gap_us;
+            pos += timing_decode(emits[i].data + pos, emits[i].len - pos, out, &out_len, &gap_us);
+            for (size_t k = 0; k < out_len && count < SIM_MAX; k++)
+            {
+                if (out[k] != sim_data[count])
+                {
+                    printf("timing: byte %zu: %02x, expect %02x\n", count, out[k], sim_data[count]);
+                    return 1;
+                }
+                gap[count++] = pending;
+                pending = 0;
+            }
+            pending += gap_us;
+        }
+    }
+    if (count != sim_len)
+    {
+        printf("timing: %zu bytes, expect %zu\n", count, sim_len);
+        return 1;
+    }
+    int64_t worst = 0;
+    for (size_t i = 1; i < count; i++)
+    {
+        int64_t actual = sim_end[i] - char_us - sim_end[i - 1];
+        int64_t err = (int64_t)gap[i] - actual;
+        bool ok = actual > TIMING_GAP_MAX_US ? gap[i] >= TIMING_GAP_MAX_US : err <= char_us && -err <= char_us;
+        if (!ok)
+        {
+            printf("timing: byte %zu: gap %u us, expect %lld us\n", i, gap[i], (long long)actual);
+            errors++;
+        }
+        if (actual <= TIMING_GAP_MAX_US && (err < 0 ? -err : err) > worst)
+            worst = err < 0 ? -err : err;
+    }
+    // 连续数据装满一帧，之后的断续数据拼接到空闲超过TIMING_FLUSH_IDLE_US为止
+    if (emit_count != 4)
+    {
+        printf("timing: %zu frames, expect 4\n", emit_count);
+        errors++;
+    }
+    int64_t latency = emits[emit_count - 1].at - sim_end[sim_len - 1];
+    if (latency > TIMING_FLUSH_IDLE_US + s.report_us + POLL_US)
+    {
+        printf("timing: flush latency %lld us\n", (long long)latency);
+        errors++;
+    }
+    printf("%-14s %2zu frames, worst gap error %4lld us, flush latency %4lld us: %s\n", "timing", emit_count,
+           (long long)worst, (long long)latency, errors == 0 ? "ok" : "FAILED");
+    return errors;
+}
+
+int main(void)
+{
+    int errors = 0;
+    errors += test_delimiter();
+    errors += test_slip();
+    errors += test_cobs();
+    errors += test_mavlink();
+    errors += test_modbus(115200);
+    errors += test_modbus(9600);
+    errors += test_none();
+    errors += test_timing();
+    printf("check: %s\n", errors == 0 ? "ok" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+/*
+ * UDP收发与广播发现的主机端测试
+ *
+ * 编译运行：cc -Imain tools/udp_loopback_test.c main/udp_link.c -o udp_loopback_test && ./udp_loopback_test
+ *
+ * 在Linux回环网络上打开两个端点：分别绑定127.0.0.2和127.0.0.3的同一端口，把对方的地址作为
+ * 广播地址，模拟同一局域网中的两个设备。检查广播发现后用收到的发送方地址单播回复，
+ * MTU大小的数据报完整送达，以及连续发送的数据报按顺序到达。
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "udp_link.h"
+
+#define TEST_PORT 47890
+#define TEST_IP_A 0x7F000002 // 127.0.0.2
+#define TEST_IP_B 0x7F000003 // 127.0.0.3
+// 与CONFIG_WLCON_UDP_MTU的默认值相同
+#define TEST_MTU 1400
+#define TEST_BURST 64
+
+static const uint8_t broadcast_addr[UDP_LINK_ADDR_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static int open_link(udp_link_t *link, uint32_t ip, uint32_t peer_ip)
+{
+    if (udp_link_open(link, ip, TEST_PORT, peer_ip) != 0)
+    {
+        printf("open %08x:%d fail: %s\n", ip, TEST_PORT, strerror(errno));
+        return -1;
+    }
+    // 丢包时不要永远阻塞
+    struct timeval tv = {.tv_sec = 1};
+    setsockopt(link->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return 0;
+}
+
+static int expect_recv(const udp_link_t *link, uint8_t *from, const uint8_t *data, size_t len, const char *what)
+{
+    static uint8_t buf[TEST_MTU + 1];
+    int got = udp_link_recv(link, from, buf, sizeof(buf));
+    if (got != (int)len || memcmp(buf, data, len) != 0)
+    {
+        printf("%s: expect %zu bytes, got %d\n", what, len, got);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    udp_link_t a, b;
+    uint8_t from[UDP_LINK_ADDR_LEN], addr_a[UDP_LINK_ADDR_LEN], addr_b[UDP_LINK_ADDR_LEN];
+    static uint8_t data[TEST_MTU];
+    int errors = 0;
+    if (open_link(&a, TEST_IP_A, TEST_IP_B) != 0 || open_link(&b, TEST_IP_B, TEST_IP_A) != 0)
+        return 1;
+    udp_link_make_addr(TEST_IP_A, TEST_PORT, addr_a);
+    udp_link_make_addr(TEST_IP_B, TEST_PORT, addr_b);
+
+    // 广播发现：收到的发送方地址用于单播回复
+    const uint8_t hello[] = "broadcast";
+    if (udp_link_send(&a, broadcast_addr, hello, sizeof(hello)) != 0)
+        errors++;
+    errors += expect_recv(&b, from, hello, sizeof(hello), "broadcast");
+    if (memcmp(from, addr_a, UDP_LINK_ADDR_LEN) != 0)
+    {
+        printf("broadcast: wrong sender address\n");
+        errors++;
+    }
+    const uint8_t reply[] = "unicast";
+    if (udp_link_send(&b, from, reply, sizeof(reply)) != 0)
+        errors++;
+    errors += expect_recv(&a, from, reply, sizeof(reply), "unicast");
+    if (memcmp(from, addr_b, UDP_LINK_ADDR_LEN) != 0)
+    {
+        printf("unicast: wrong sender address\n");
+        errors++;
+    }
+
+    // MTU大小的数据报
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = i * 7 + 3;
+    if (udp_link_send(&a, addr_b, data, sizeof(data)) != 0)
+        errors++;
+    errors += expect_recv(&b, from, data, sizeof(data), "mtu");
+
+    // 连续发送，回环上不丢包也不乱序
+    for (int i = 0; i < TEST_BURST; i++)
+    {
+        data[0] = i;
+        if (udp_link_send(&b, addr_a, data, 1 + i) != 0)
+            errors++;
+    }
+    for (int i = 0; i < TEST_BURST; i++)
+    {
+        data[0] = i;
+        if (expect_recv(&a, from, data, 1 + i, "burst") != 0)
+        {
+            errors++;
+            break;
+        }
+    }
+
+    udp_link_close(&a);
+    udp_link_close(&b);
+    printf("check: %s\n", errors == 0 ? "ok" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
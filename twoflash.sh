@@ -1,3 +1,3 @@
-python /home/wlx/program/espressif/esp8266/ESP8266_RTOS_SDK/components/esptool_py/esptool/esptool.py --chip esp8266 --port /dev/ttyUSB0 --baud 115200 --before default_reset --after hard_reset write_flash -z --flash_mode dio --flash_freq 40m --flash_size 2MB 0x0 /home/wlx/work/wireless-serial/build/bootloader/bootloader.bin 0x10000 /home/wlx/work/wireless-serial/build/hello-world.bin 0x8000 /home/wlx/work/wireless-serial/build/partitions_singleapp.bin
+python /home/wlx/program/espressif/esp8266/ESP8266_RTOS_SDK/components/esptool_py/esptool/esptool.py --chip esp8266 --port /dev/ttyUSB0 --baud 115200 --before default_reset --after hard_reset write_flash -z --flash_mode dio --flash_freq 40m --flash_size 2MB 0x0 /home/wlx/work/wireless-serial/build/bootloader/bootloader.bin 0x10000 /home/wlx/work/wireless-serial/build/hello-world.bin 0x8000 /home/wlx/work/wireless-serial/build/partitions.bin
 
-python /home/wlx/program/espressif/esp8266/ESP8266_RTOS_SDK/components/esptool_py/esptool/esptool.py --chip esp8266 --port /dev/ttyUSB1 --baud 115200 --before default_reset --after hard_reset write_flash -z --flash_mode dio --flash_freq 40m --flash_size 2MB 0x0 /home/wlx/work/wireless-serial/build/bootloader/bootloader.bin 0x10000 /home/wlx/work/wireless-serial/build/hello-world.bin 0x8000 /home/wlx/work/wireless-serial/build/partitions_singleapp.bin
\ No newline at end of file
+python /home/wlx/program/espressif/esp8266/ESP8266_RTOS_SDK/components/esptool_py/esptool/esptool.py --chip esp8266 --port /dev/ttyUSB1 --baud 115200 --before default_reset --after hard_reset write_flash -z --flash_mode dio --flash_freq 40m --flash_size 2MB 0x0 /home/wlx/work/wireless-serial/build/bootloader/bootloader.bin 0x10000 /home/wlx/work/wireless-serial/build/hello-world.bin 0x8000 /home/wlx/work/wireless-serial/build/partitions.bin
\ No newline at end of file